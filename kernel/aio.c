@@ -0,0 +1,179 @@
+//
+// Asynchronous file reads and writes.
+//
+// aiosubmit() hands each request to a kernel thread of its
+// own, which does the blocking fileread() or filewrite() and
+// then sends the submitter a SIGNAL_AIO carrying the request
+// id and the result. The thread gets a page table of its own
+// holding just the buffer's pages, pinned by uvmpin(), so
+// whatever the submitter does to its mappings meanwhile, the
+// thread only ever touches pages it holds a reference to.
+// exit() and exec() call aiodrain() to cancel requests whose
+// results nobody would see.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "proc.h"
+#include "fs.h"
+#include "sleeplock.h"
+#include "file.h"
+
+struct aioreq {
+  int busy;
+  int write;             // filewrite() rather than fileread()
+  int id;                // Chosen by the submitter
+  int n;
+  uint64 addr;
+  pagetable_t pagetable; // Just the pinned buffer, at addr
+  struct file *f;        // Reference held for the request
+  struct proc *owner;    // Submitter; waits in aiodrain() for us
+  struct sigentry *done; // Owner's queue slot for the SIGNAL_AIO
+  int pid;               // Thread doing the request
+};
+
+struct {
+  struct spinlock lock;
+  struct aioreq req[NAIO];
+} aio;
+
+void
+aioinit(void)
+{
+  initlock(&aio.lock, "aio");
+}
+
+// Body of a request's kernel thread.
+static void
+aioworker(void *arg)
+{
+  struct aioreq *r = arg;
+  struct proc *owner = r->owner;
+  int result;
+
+  if(r->write)
+    result = filewrite(r->f, r->addr, r->n);
+  else
+    result = fileread(r->f, r->addr, r->n);
+  fileclose(r->f);
+  uvmunpin(r->pagetable, r->addr, r->n);
+  uvmfree(r->pagetable, 0);
+
+  // The slot was reserved at submit time, so the completion
+  // can't be lost to a full queue. aiodrain() keeps owner
+  // from being freed until we are done.
+  sigpost(owner, r->done, (signal_t){
+    .type = SIGNAL_AIO,
+    .sender_pid = myproc()->pid,
+    .payload = ((uint64)r->id << 32) | (uint)result,
+  });
+
+  acquire(&aio.lock);
+  r->busy = 0;
+  owner->naio--;
+  wakeup(&owner->naio);
+  release(&aio.lock);
+}
+
+// Start reading or writing n bytes at user address addr
+// from f. Returns at once, or -1 if the buffer is not all
+// mapped (and writable, for a read), too many requests are
+// in flight already, or the caller's signal queue has no
+// room left for the completion.
+int
+aiosubmit(struct file *f, uint64 addr, int n, int id, int write)
+{
+  struct proc *p = myproc();
+  struct aioreq *r;
+  struct sigentry *done;
+  pagetable_t pt;
+  int pid;
+
+  if(n < 0 || (write ? !f->writable : !f->readable))
+    return -1;
+  if(addr + n < addr || addr + n > p->sz)
+    return -1;
+  if((pt = uvmcreate()) == 0)
+    return -1;
+  if(uvmpin(p->pagetable, pt, addr, n, !write) < 0){
+    uvmfree(pt, 0);
+    return -1;
+  }
+  if((done = sigreserve(p)) == 0){
+    uvmunpin(pt, addr, n);
+    uvmfree(pt, 0);
+    return -1;
+  }
+
+  acquire(&aio.lock);
+  for(r = aio.req; r < &aio.req[NAIO]; r++)
+    if(!r->busy)
+      break;
+  if(r == &aio.req[NAIO]){
+    release(&aio.lock);
+    sigunreserve(p, done);
+    uvmunpin(pt, addr, n);
+    uvmfree(pt, 0);
+    return -1;
+  }
+  r->busy = 1;
+  r->write = write;
+  r->id = id;
+  r->n = n;
+  r->addr = addr;
+  r->pagetable = pt;
+  r->f = filedup(f);
+  r->owner = p;
+  r->done = done;
+  r->pid = 0;
+  p->naio++;
+  release(&aio.lock);
+
+  if((pid = kthread("aio", aioworker, r, pt)) < 0){
+    fileclose(r->f);
+    sigunreserve(p, done);
+    uvmunpin(pt, addr, n);
+    uvmfree(pt, 0);
+    acquire(&aio.lock);
+    r->busy = 0;
+    p->naio--;
+    release(&aio.lock);
+    return -1;
+  }
+
+  // The thread may be done, and r handed to someone else.
+  acquire(&aio.lock);
+  if(r->busy && r->owner == p)
+    r->pid = pid;
+  release(&aio.lock);
+  return 0;
+}
+
+// Kill p's outstanding requests and wait for their threads
+// to finish. A request blocked on a pipe or console ends
+// early, with -1 as its result.
+void
+aiodrain(struct proc *p)
+{
+  struct aioreq *r;
+  int pids[NAIO], n;
+
+  acquire(&aio.lock);
+  n = 0;
+  for(r = aio.req; r < &aio.req[NAIO]; r++)
+    if(r->busy && r->owner == p && r->pid > 0)
+      pids[n++] = r->pid;
+  release(&aio.lock);
+
+  while(n > 0)
+    kill(pids[--n]);
+
+  acquire(&aio.lock);
+  while(p->naio > 0)
+    sleep(&p->naio, &aio.lock);
+  release(&aio.lock);
+}
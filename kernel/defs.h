@@ -5,11 +5,21 @@ struct context;
 struct file;
 struct inode;
 struct pipe;
+struct mchan;
 struct proc;
 struct spinlock;
 struct sleeplock;
+struct sigentry;
+struct slab;
 struct stat;
 struct superblock;
+struct timer;
+struct hrtimer;
+
+// aio.c
+void            aioinit(void);
+int             aiosubmit(struct file*, uint64, int, int, int);
+void            aiodrain(struct proc*);
 
 // bio.c
 void            binit(void);
@@ -63,6 +73,10 @@ void            ramdiskrw(struct buf*);
 
 // kalloc.c
 void*           kalloc(void);
+void*           kzalloc(void);
+int             kzerofill(void);
+void            kdup(void *);
+int             krefs(void *);
 void            kfree(void *);
 void            kinit(void);
 
@@ -72,6 +86,11 @@ void            log_write(struct buf*);
 void            begin_op(void);
 void            end_op(void);
 
+// mchan.c
+void            mchaninit(void);
+uint64          mchanopen(int);
+void            mchanclose(struct proc*, pagetable_t);
+
 // pipe.c
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
@@ -87,10 +106,20 @@ void            printfinit(void);
 int             cpuid(void);
 void            exit(int);
 int             fork(void);
+int             kthread(char*, void (*)(void*), void*, pagetable_t);
+struct proc*    findproc(int);
 int             send_signal(signal_t signal, int receiver_pid);
+int             send_signal_group(signal_t signal, int pgid);
+struct sigentry* sigreserve(struct proc*);
+void            sigunreserve(struct proc*, struct sigentry*);
+void            sigpost(struct proc*, struct sigentry*, signal_t);
+int             setpgid(int, int);
+int             getpgid(int);
 int             set_signal_handler(enum signal_type type, signal_handler_t new_handler);
+int             set_signal_batch_handler(enum signal_type type, signal_batch_handler_t new_handler);
+int             sigaltstack(uint64, uint64);
+void            sigstackfree(struct proc*, pagetable_t);
 int             growproc(int);
-void            proc_mapstacks(pagetable_t);
 pagetable_t     proc_pagetable(struct proc *);
 void            proc_freepagetable(pagetable_t, uint64);
 int             kill(int);
@@ -102,7 +131,8 @@ struct proc*    myproc();
 void            procinit(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
-int             sleep(void*, struct spinlock*);
+void            sleep(void*, struct spinlock*);
+int             sleepintr(void*, struct spinlock*);
 void            userinit(void);
 int             wait(uint64);
 void            wakeup(void*);
@@ -110,7 +140,14 @@ void            yield(void);
 int             either_copyout(int user_dst, uint64 dst, void *src, uint64 len);
 int             either_copyin(void *dst, int user_src, uint64 src, uint64 len);
 void            procdump(void);
-int             alarm(struct proc * alarmed_proc, unsigned int seconds);
+void            preempt(void);
+int             setpriority(int, int);
+void            deliver_signals(void);
+void            sigreset(struct proc*);
+uint64          sigreturn(void);
+int             schedstat(uint64, int, uint64, int);
+int             alarm(struct proc *p, unsigned int seconds);
+uint64          setitimer(struct proc *p, uint64 value, uint64 interval);
 
 // swtch.S
 void            swtch(struct context*, struct context*);
@@ -127,6 +164,11 @@ void            release(struct spinlock*);
 void            push_off(void);
 void            pop_off(void);
 
+// slab.c
+void            slabinit(struct slab*, char*, uint);
+void*           slaballoc(struct slab*);
+void            slabfree(struct slab*, void*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -150,12 +192,25 @@ int             fetchstr(uint64, char*, int);
 int             fetchaddr(uint64, uint64*);
 void            syscall();
 
+// timer.c
+void            timerwheelinit(void);
+void            timer_add(struct timer*, uint);
+int             timer_del(struct timer*);
+int             timer_pending(struct timer*);
+void            timer_tick(uint);
+void            hrtimer_arm(uint64);
+void            hrtimer_add(struct hrtimer*, uint64);
+int             hrtimer_del(struct hrtimer*);
+int             hrtimer_intr(void);
+
 // trap.c
 extern uint     ticks;
 void            trapinit(void);
 void            trapinithart(void);
 extern struct spinlock tickslock;
 void            usertrapret(void);
+void            clockarm(void);
+void            ipi(struct cpu*);
 
 // uart.c
 void            uartinit(void);
@@ -166,6 +221,8 @@ int             uartgetc(void);
 
 // vm.c
 void            kvminit(void);
+int             kvmmapstack(uint64, uint64);
+void            kvmunmapstack(uint64);
 void            kvminithart(void);
 void            kvmmap(pagetable_t, uint64, uint64, uint64, int);
 int             mappages(pagetable_t, uint64, uint64, uint64, int);
@@ -177,6 +234,9 @@ int             uvmcopy(pagetable_t, pagetable_t, uint64);
 void            uvmfree(pagetable_t, uint64);
 void            uvmunmap(pagetable_t, uint64, uint64, int);
 void            uvmclear(pagetable_t, uint64);
+int             uvmcow(pagetable_t, uint64);
+int             uvmpin(pagetable_t, pagetable_t, uint64, uint64, int);
+void            uvmunpin(pagetable_t, uint64, uint64);
 pte_t *         walk(pagetable_t, uint64, int);
 uint64          walkaddr(pagetable_t, uint64);
 int             copyout(pagetable_t, uint64, char *, uint64);
@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "timer.h"
 #include "proc.h"
 #include "defs.h"
 #include "elf.h"
@@ -127,8 +128,14 @@ exec(char *path, char **argv)
   p->sz = sz;
   p->trapframe->epc = elf.entry;  // initial program counter = main
   p->trapframe->sp = sp; // initial stack pointer
+  aiodrain(p);
+  sigstackfree(p, oldpagetable);
+  mchanclose(p, oldpagetable);
   proc_freepagetable(oldpagetable, oldsz);
 
+  // Handlers pointed into the old image.
+  sigreset(p);
+
   return argc; // this ends up in a0, the first argument to main(argc, argv)
 
  bad:
@@ -1,6 +1,19 @@
 // Physical memory allocator, for user processes,
 // kernel stacks, page-table pages,
 // and pipe buffers. Allocates whole 4096-byte pages.
+//
+// Each hart keeps a cache of free pages, so most calls
+// only take that hart's own lock. A cache refills from and
+// drains to the global list KCACHE_BATCH pages at a time,
+// and a hart that finds both empty steals half of another
+// hart's cache.
+//
+// Each hart also keeps up to KZERO_MAX pages zeroed ahead of
+// time by its idle loop, for kzalloc().
+//
+// Every allocated page has a reference count, so that fork
+// can share pages copy-on-write. kfree() only frees a page
+// when its last reference goes.
 
 #include "types.h"
 #include "param.h"
@@ -23,10 +36,27 @@ struct {
   struct run *freelist;
 } kmem;
 
+// A hart's page cache. Its own hart takes the lock with
+// interrupts off; other harts only take it to steal.
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;
+  struct run *zerolist;        // Pages already zeroed
+  int nzero;
+} kcache[NCPU];
+
+// References to each page, indexed by PAGEREF().
+// Updated atomically.
+#define PAGEREF(pa) (((uint64)(pa) - KERNBASE) / PGSIZE)
+int pageref[PAGEREF(PHYSTOP)];
+
 void
 kinit()
 {
   initlock(&kmem.lock, "kmem");
+  for(int i = 0; i < NCPU; i++)
+    initlock(&kcache[i].lock, "kcache");
   freerange(end, (void*)PHYSTOP);
 }
 
@@ -35,31 +65,160 @@ freerange(void *pa_start, void *pa_end)
 {
   char *p;
   p = (char*)PGROUNDUP((uint64)pa_start);
-  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)pa_end; p += PGSIZE){
+    pageref[PAGEREF(p)] = 1;
     kfree(p);
+  }
 }
 
-// Free the page of physical memory pointed at by pa,
-// which normally should have been returned by a
-// call to kalloc().  (The exception is when
-// initializing the allocator; see kinit above.)
+// Move up to n pages from c to the global list.
+// Caller must hold c->lock.
+static void
+kdrain(struct kcache *c, int n)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  while(n-- > 0 && (r = c->freelist) != 0){
+    c->freelist = r->next;
+    c->n--;
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+  }
+  release(&kmem.lock);
+}
+
+// Move up to KCACHE_BATCH pages from the global list to c.
+// Caller must hold c->lock.
+static void
+krefill(struct kcache *c)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  for(int i = 0; i < KCACHE_BATCH && (r = kmem.freelist) != 0; i++){
+    kmem.freelist = r->next;
+    r->next = c->freelist;
+    c->freelist = r;
+    c->n++;
+  }
+  release(&kmem.lock);
+}
+
+// Take half of the first other cache that has pages, keep
+// one and put the rest in hart id's cache. Returns the page
+// kept, or 0 if every cache is empty. Called with no kcache
+// lock held, so two harts stealing from each other can't
+// deadlock.
+static struct run*
+ksteal(int id)
+{
+  struct kcache *c;
+  struct run *r, *list, *last;
+  int n = 0;
+
+  list = 0;
+  for(int i = 1; i < NCPU && list == 0; i++){
+    c = &kcache[(id + i) % NCPU];
+    acquire(&c->lock);
+    if(c->n > 0){
+      n = (c->n + 1) / 2;
+      list = last = c->freelist;
+      for(int k = 1; k < n; k++)
+        last = last->next;
+      c->freelist = last->next;
+      c->n -= n;
+      last->next = 0;
+    }
+    release(&c->lock);
+  }
+  if(list == 0)
+    return 0;
+
+  r = list;
+  if(n > 1){
+    c = &kcache[id];
+    acquire(&c->lock);
+    last->next = c->freelist;
+    c->freelist = r->next;
+    c->n += n - 1;
+    release(&c->lock);
+  }
+  return r;
+}
+
+// When every free list is empty, take a page that some
+// hart has zeroed ahead of time.
+static struct run*
+kzsteal(void)
+{
+  struct kcache *c;
+  struct run *r = 0;
+
+  for(c = kcache; c < &kcache[NCPU] && r == 0; c++){
+    acquire(&c->lock);
+    if((r = c->zerolist) != 0){
+      c->zerolist = r->next;
+      c->nzero--;
+    }
+    release(&c->lock);
+  }
+  return r;
+}
+
+// Add a reference to a page returned by kalloc().
+void
+kdup(void *pa)
+{
+  if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
+    panic("kdup");
+  __atomic_fetch_add(&pageref[PAGEREF(pa)], 1, __ATOMIC_RELAXED);
+}
+
+// Number of references to a page returned by kalloc().
+int
+krefs(void *pa)
+{
+  return __atomic_load_n(&pageref[PAGEREF(pa)], __ATOMIC_ACQUIRE);
+}
+
+// Drop a reference to the page of physical memory pointed
+// at by pa, and free it if that was the last one. The page
+// normally should have been returned by a call to kalloc().
+// (The exception is when initializing the allocator; see
+// kinit above.)
 void
 kfree(void *pa)
 {
   struct run *r;
+  struct kcache *c;
+  int n;
 
   if(((uint64)pa % PGSIZE) != 0 || (char*)pa < end || (uint64)pa >= PHYSTOP)
     panic("kfree");
 
+  n = __atomic_sub_fetch(&pageref[PAGEREF(pa)], 1, __ATOMIC_ACQ_REL);
+  if(n > 0)
+    return;
+  if(n < 0)
+    panic("kfree: freed twice");
+
+#ifdef KALLOC_JUNK
   // Fill with junk to catch dangling refs.
   memset(pa, 1, PGSIZE);
+#endif
 
   r = (struct run*)pa;
 
-  acquire(&kmem.lock);
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  release(&kmem.lock);
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  if(++c->n > KCACHE_MAX)
+    kdrain(c, KCACHE_BATCH);
+  release(&c->lock);
+  pop_off();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -69,14 +228,102 @@ void *
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
+  int id;
 
-  acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
-  release(&kmem.lock);
+  push_off();
+  id = cpuid();
+  c = &kcache[id];
+  acquire(&c->lock);
+  if(c->freelist == 0)
+    krefill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0)
+    r = ksteal(id);
+  if(r == 0)
+    r = kzsteal();
+  pop_off();
+
+  if(r == 0)
+    return 0;
+  pageref[PAGEREF(r)] = 1;
+#ifdef KALLOC_JUNK
+  memset((char*)r, 5, PGSIZE); // fill with junk
+#endif
+  return (void*)r;
+}
+
+// Allocate one zeroed page, from this hart's pre-zeroed
+// pages if it has any. Returns 0 if out of memory.
+void *
+kzalloc(void)
+{
+  struct run *r;
+  struct kcache *c;
+
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  r = c->zerolist;
+  if(r){
+    c->zerolist = r->next;
+    c->nzero--;
+  }
+  release(&c->lock);
+  pop_off();
 
-  if(r)
-    memset((char*)r, 5, PGSIZE); // fill with junk
+  if(r){
+    r->next = 0;  // the only word the list dirtied
+    pageref[PAGEREF(r)] = 1;
+    return (void*)r;
+  }
+  if((r = kalloc()) != 0)
+    memset((char*)r, 0, PGSIZE);
   return (void*)r;
 }
+
+// Zero one free page for this hart's kzalloc() pool.
+// Returns 1 if it did, or 0 if the pool is full or there
+// are no free pages. Called by the scheduler when idle.
+int
+kzerofill(void)
+{
+  struct run *r;
+  struct kcache *c;
+
+  push_off();
+  c = &kcache[cpuid()];
+  acquire(&c->lock);
+  if(c->nzero >= KZERO_MAX){
+    release(&c->lock);
+    pop_off();
+    return 0;
+  }
+  if(c->freelist == 0)
+    krefill(c);
+  r = c->freelist;
+  if(r){
+    c->freelist = r->next;
+    c->n--;
+  }
+  release(&c->lock);
+  if(r == 0){
+    pop_off();
+    return 0;
+  }
+
+  memset((char*)r, 0, PGSIZE);
+
+  acquire(&c->lock);
+  r->next = c->zerolist;
+  c->zerolist = r;
+  c->nzero++;
+  release(&c->lock);
+  pop_off();
+  return 1;
+}
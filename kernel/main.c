@@ -5,6 +5,7 @@
 #include "defs.h"
 
 volatile static int started = 0;
+volatile uint64 cpuonline = 0;  // bit i is set once hart i schedules
 
 // start() jumps here in supervisor mode on all CPUs.
 void
@@ -21,6 +22,9 @@ main()
     kvminithart();   // turn on paging
     procinit();      // process table
     trapinit();      // trap vectors
+    timerwheelinit(); // sleep and alarm timers
+    mchaninit();     // message channels
+    aioinit();       // asynchronous I/O requests
     trapinithart();  // install kernel trap vector
     plicinit();      // set up interrupt controller
     plicinithart();  // ask PLIC for device interrupts
@@ -36,11 +40,12 @@ main()
       ;
     __sync_synchronize();
     printf("hart %d starting\n", cpuid());
-    while(cpuid() != 1);
     kvminithart();    // turn on paging
     trapinithart();   // install kernel trap vector
     plicinithart();   // ask PLIC for device interrupts
   }
 
+  // Only now may other harts queue processes here.
+  __sync_fetch_and_or(&cpuonline, 1L << cpuid());
   scheduler();        
 }
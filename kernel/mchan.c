@@ -0,0 +1,117 @@
+//
+// Shared-memory message channels.
+//
+// A channel is one page mapped into two processes, each at
+// one of its fixed MCHAN() addresses. The first of the two to
+// call mchan() with the other's pid allocates the page; the
+// other attaches to it by calling mchan() back. Messages are
+// written in place (see mchan.h), so the kernel never copies
+// them; a SIGNAL_MESSAGE serves as the doorbell.
+//
+
+#include "types.h"
+#include "riscv.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "timer.h"
+#include "proc.h"
+
+struct mchan {
+  int ref;        // Processes mapping page, 0 if unused
+  int owner;      // pid that created the channel
+  int peer;       // pid that may still attach, or 0
+  void *page;
+};
+
+struct {
+  struct spinlock lock;
+  struct mchan chan[NMCHAN];
+} mtable;
+
+void
+mchaninit(void)
+{
+  initlock(&mtable.lock, "mchan");
+}
+
+// Map c at p's first free channel address.
+// Returns the address, or 0 if none is left.
+// Caller must hold mtable.lock.
+static uint64
+mchanmap(struct proc *p, struct mchan *c)
+{
+  for(int i = 0; i < NPMCHAN; i++){
+    if(p->mchan[i])
+      continue;
+    if(mappages(p->pagetable, MCHAN(i), PGSIZE,
+                (uint64)c->page, PTE_R | PTE_W | PTE_U) < 0)
+      return 0;
+    p->mchan[i] = c;
+    c->ref++;
+    return MCHAN(i);
+  }
+  return 0;
+}
+
+// Open a channel with the process pid: attach to the one it
+// has opened with us, or else create one for it to attach
+// to. Returns the channel's address, or 0.
+uint64
+mchanopen(int pid)
+{
+  struct proc *p = myproc();
+  struct mchan *c, *free;
+  uint64 va;
+
+  if(pid <= 0 || pid == p->pid)
+    return 0;
+
+  acquire(&mtable.lock);
+  free = 0;
+  for(c = mtable.chan; c < &mtable.chan[NMCHAN]; c++){
+    if(c->ref == 0){
+      if(free == 0)
+        free = c;
+    } else if(c->owner == pid && c->peer == p->pid){
+      if((va = mchanmap(p, c)) != 0)
+        c->peer = 0;
+      release(&mtable.lock);
+      return va;
+    }
+  }
+
+  va = 0;
+  if(free && (free->page = kzalloc()) != 0){
+    free->owner = p->pid;
+    free->peer = pid;
+    if((va = mchanmap(p, free)) == 0){
+      kfree(free->page);
+      free->page = 0;
+    }
+  }
+  release(&mtable.lock);
+  return va;
+}
+
+// Unmap p's channels from pagetable, freeing each page
+// once neither process maps it.
+void
+mchanclose(struct proc *p, pagetable_t pagetable)
+{
+  struct mchan *c;
+
+  acquire(&mtable.lock);
+  for(int i = 0; i < NPMCHAN; i++){
+    if((c = p->mchan[i]) == 0)
+      continue;
+    uvmunmap(pagetable, MCHAN(i), 1, 0);
+    p->mchan[i] = 0;
+    if(--c->ref == 0){
+      kfree(c->page);
+      c->page = 0;
+    }
+  }
+  release(&mtable.lock);
+}
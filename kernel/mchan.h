@@ -0,0 +1,19 @@
+#ifndef _INCLUDE_KERNEL_MCHAN_H_
+#define _INCLUDE_KERNEL_MCHAN_H_
+
+// Layout of a message channel page, shared by the two
+// processes that opened it (see mchan.c). One side sends:
+// it fills the slot at tail, then advances tail. The other
+// receives: it reads the slot at head, then advances head.
+// Both only grow, and are taken mod MCHAN_NSLOT.
+#define MCHAN_SLOTSIZE 256
+#define MCHAN_NSLOT    15
+
+struct mchan_ring {
+  uint head;                   // Next slot to read; written by the receiver
+  uint tail;                   // Next slot to fill; written by the sender
+  char pad[MCHAN_SLOTSIZE - 2*sizeof(uint)];
+  char slot[MCHAN_NSLOT][MCHAN_SLOTSIZE];
+};
+
+#endif
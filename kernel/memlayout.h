@@ -27,6 +27,7 @@
 
 // core local interruptor (CLINT), which contains the timer.
 #define CLINT 0x2000000L
+#define CLINT_MSIP(hartid) (CLINT + 4*(hartid)) // inter-processor interrupts.
 #define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8*(hartid))
 #define CLINT_MTIME (CLINT + 0xBFF8) // cycles since boot.
 
@@ -53,7 +54,10 @@
 
 // map kernel stacks beneath the trampoline,
 // each surrounded by invalid guard pages.
+// There is a slot per page of RAM, so memory
+// always runs out before the slots do.
 #define KSTACK(p) (TRAMPOLINE - ((p)+1)* 2*PGSIZE)
+#define NKSTACK ((PHYSTOP - KERNBASE) / PGSIZE)
 
 // User memory layout.
 // Address zero first:
@@ -62,9 +66,16 @@
 //   fixed-size stack
 //   expandable heap
 //   ...
+//   MCHAN(NPMCHAN-1) .. MCHAN(0) (message channels)
+//   SIGNALSTACK (once a handler is installed)
+//   SIGNALRET
 //   TRAPFRAME (p->trapframe, used by the trampoline)
 //   TRAMPOLINE (the same page as in the kernel)
 #define TRAPFRAME (TRAMPOLINE - PGSIZE)
 
 #define SIGNALRET (TRAPFRAME - PGSIZE)
-#define SIGNALSTACK (SIGNALRET - PGSIZE)
\ No newline at end of file
+#define SIGNALSTACK (SIGNALRET - PGSIZE)
+
+// message channel pages (see mchan.c), below the signal stack;
+// the heap may not grow past the lowest.
+#define MCHAN(i) (SIGNALSTACK - ((i)+1)*PGSIZE)
\ No newline at end of file
@@ -1,4 +1,3 @@
-#define NPROC        64  // maximum number of processes
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
 #define NFILE       100  // open files per system
@@ -11,5 +10,28 @@
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       2000  // size of file system in blocks
 #define MAXPATH      128   // maximum file path name
+#define NPIDHASH   256   // pid lookup hash buckets
+#define NWAITQ      64   // sleep/wakeup channel hash buckets
+#define NPRIO        4   // MLFQ priority levels, 0 is the highest
+#define MLFQ_BOOST  50   // ticks between MLFQ priority resets
+#define STEAL_IDLE     1   // an idle cpu steals from queues at least this long
+#define STEAL_BUSY     2   // a busy cpu pulls work when another queue is this much longer
+#define MAXSIGQUEUE 512   // signals a process may have pending
+#define SIGBATCH    128   // most signals passed to one batch handler call
+#define MINSIGSTACK 4096  // smallest stack sigaltstack() accepts
+#define KCACHE_MAX    64  // free pages a hart keeps before draining some
+#define KCACHE_BATCH  32  // pages moved to or from the global list at once
+#define KZERO_MAX     32  // pages a hart zeroes ahead of time while idle
+#define NMCHAN       64   // message channels in the system
+#define NPMCHAN       4   // message channels mapped per process
+#define NAIO         32   // asynchronous I/O requests in flight
+#define TICKINTERVAL 1000000 // timer cycles per tick; about 1/10th second in qemu
+#define ITIMERMIN    10000   // shortest setitimer() period, in timer cycles
 
-// #define ENABLE_DEBUG_PROC_PRINT 1
\ No newline at end of file
+// #define ENABLE_DEBUG_PROC_PRINT 1
+// #define KALLOC_JUNK 1  // fill kalloc()ed and kfree()d pages with junk
+
+// Scheduling policy, chosen with make SCHED=RR or make SCHED=MLFQ.
+#if !defined(SCHED_RR) && !defined(SCHED_MLFQ)
+#define SCHED_RR
+#endif
\ No newline at end of file
@@ -3,7 +3,10 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "timer.h"
 #include "proc.h"
+#include "slab.h"
+#include "schedstat.h"
 #include "defs.h"
 
 #if ENABLE_DEBUG_PROC_PRINT
@@ -14,7 +17,21 @@
 
 struct cpu cpus[NCPU];
 
-struct proc proc[NPROC];
+// Process descriptors are carved out of slab pages on
+// demand, so there is no fixed limit on their number.
+struct slab procslab;
+
+// Pending signals, for all processes.
+struct slab sigslab;
+
+// Live processes, hashed by pid so that kill(),
+// send_signal() and procdump() can find them.
+struct pidhash pidhash[NPIDHASH];
+struct pidhash pgrphash[NPIDHASH];  // by process group id
+
+// Sleeping processes, hashed by channel so that wakeup()
+// only visits processes that might be waiting on it.
+struct waitq waitq[NWAITQ];
 
 struct proc *initproc;
 
@@ -22,7 +39,16 @@ int nextpid = 1;
 struct spinlock pid_lock;
 
 extern void forkret(void);
+static void kthreadret(void);
 static void freeproc(struct proc *p);
+static void putproc(struct proc *p);
+static void swtchout(struct proc *p, int preempted);
+static int queue_signal(struct proc *p, signal_t signal, int n);
+static void sigwake(struct proc *p);
+static void alarmtimer(struct hrtimer *t);
+static int sigpending(struct proc *p);
+static void sigdrain(struct proc *p);
+static int sigstackmap(struct proc *p);
 
 extern char trampoline[]; // trampoline.S
 extern char signalret[]; // signal.S
@@ -39,36 +65,83 @@ __wfi(void)
 // must be acquired before any p->lock.
 struct spinlock wait_lock;
 
-// Allocate a page for each process's kernel stack.
-// Map it high in memory, followed by an invalid
-// guard page.
-void
-proc_mapstacks(pagetable_t kpgtbl)
+// Kernel stacks live at KSTACK(slot), above an unmapped
+// guard page, so that an overflow faults. A slot is mapped
+// to a fresh page when a process takes it, and unmapped and
+// freed with the process.
+//
+// Another hart may still cache a freed slot's translation.
+// Nothing uses the address until the slot is mapped again,
+// and each mapping bumps gen: scheduler() flushes its TLB
+// before running a process if gen moved since its last flush.
+struct {
+  struct spinlock lock;
+  uint64 used[NKSTACK/64];  // Bit per slot in use
+  int hint;                 // Word of used[] to search first
+  uint gen;                 // Times a slot has been mapped
+} kstacks;
+
+// Return the address of a newly mapped kernel stack page,
+// or 0 if out of memory.
+static uint64
+kstackalloc(void)
 {
-  struct proc *p;
-  
-  for(p = proc; p < &proc[NPROC]; p++) {
-    char *pa = kalloc();
-    if(pa == 0)
-      panic("kalloc");
-    uint64 va = KSTACK((int) (p - proc));
-    kvmmap(kpgtbl, va, (uint64)pa, PGSIZE, PTE_R | PTE_W);
+  int w, b;
+  char *pa;
+
+  if((pa = kalloc()) == 0)
+    return 0;
+  acquire(&kstacks.lock);
+  for(w = kstacks.hint; ~kstacks.used[w] == 0; ){
+    w = (w + 1) % (NKSTACK/64);
+    if(w == kstacks.hint)
+      panic("kstackalloc");  // more slots than pages
   }
+  for(b = 0; kstacks.used[w] & (1L << b); b++)
+    ;
+  if(kvmmapstack(KSTACK(w*64 + b), (uint64)pa) < 0){
+    release(&kstacks.lock);
+    kfree(pa);
+    return 0;
+  }
+  kstacks.used[w] |= 1L << b;
+  kstacks.hint = w;
+  __atomic_fetch_add(&kstacks.gen, 1, __ATOMIC_RELEASE);
+  release(&kstacks.lock);
+  return KSTACK(w*64 + b);
+}
+
+// Unmap and free a stack from kstackalloc().
+static void
+kstackfree(uint64 kstack)
+{
+  int slot = (TRAMPOLINE - kstack) / (2*PGSIZE) - 1;
+
+  acquire(&kstacks.lock);
+  kvmunmapstack(kstack);
+  kstacks.used[slot / 64] &= ~(1L << (slot % 64));
+  release(&kstacks.lock);
 }
 
 // initialize the proc table.
 void
 procinit(void)
 {
-  struct proc *p;
+  struct cpu *c;
   
   initlock(&pid_lock, "nextpid");
   initlock(&wait_lock, "wait_lock");
-  for(p = proc; p < &proc[NPROC]; p++) {
-      initlock(&p->lock, "proc");
-      p->state = UNUSED;
-      p->kstack = KSTACK((int) (p - proc));
-  }
+  initlock(&kstacks.lock, "kstacks");
+  for(c = cpus; c < &cpus[NCPU]; c++)
+      initlock(&c->rq.lock, "runq");
+  for(int i = 0; i < NWAITQ; i++)
+      initlock(&waitq[i].lock, "waitq");
+  for(int i = 0; i < NPIDHASH; i++)
+      initlock(&pidhash[i].lock, "pidhash");
+  for(int i = 0; i < NPIDHASH; i++)
+      initlock(&pgrphash[i].lock, "pgrphash");
+  slabinit(&procslab, "proc", sizeof(struct proc));
+  slabinit(&sigslab, "signal", sizeof(struct sigentry));
 }
 
 // Must be called with interrupts disabled,
@@ -102,6 +175,344 @@ myproc(void)
   return p;
 }
 
+// Whether c's hart has reached scheduler(). Only harts that
+// qemu started do; the rest of cpus[] is never served.
+static int
+cpu_online(struct cpu *c)
+{
+  return (cpuonline >> (c - cpus)) & 1;
+}
+
+// Append p to the tail of its level in rq.
+// Caller must hold rq->lock.
+static void
+runq_append(struct runq *rq, struct proc *p)
+{
+#ifdef SCHED_MLFQ
+  int q = p->prio;
+#else
+  int q = 0;
+#endif
+
+  p->rqnext = 0;
+  if(rq->tail[q])
+    rq->tail[q]->rqnext = p;
+  else
+    rq->head[q] = p;
+  rq->tail[q] = p;
+}
+
+// Wake a cpu to run p, newly queued on c: c itself if
+// it is idle, otherwise any idle cpu, which will steal it.
+static void
+runq_kick(struct cpu *c, struct proc *p)
+{
+  struct cpu *o;
+
+  // Pairs with the barrier in scheduler(): either the idle
+  // cpu sees the queued process, or we see it in wfi.
+  __sync_synchronize();
+  if(c->inwfi){
+    ipi(c);
+    return;
+  }
+  // A process requeueing itself is picked up right here.
+  if(p == mycpu()->proc)
+    return;
+  for(o = cpus; o < &cpus[NCPU]; o++){
+    if(cpu_online(o) && o->inwfi){
+      ipi(o);
+      return;
+    }
+  }
+}
+
+// Append p to the tail of c's run queue.
+// Caller must hold p->lock.
+static void
+runq_push(struct cpu *c, struct proc *p)
+{
+  p->tstamp = r_time();
+  acquire(&c->rq.lock);
+  runq_append(&c->rq, p);
+  c->rq.len++;
+  p->cpu = c - cpus;
+  release(&c->rq.lock);
+  runq_kick(c, p);
+}
+
+// Remove and return the process at the head of the highest
+// non-empty level of c's run queue, or 0 if it is empty.
+static struct proc*
+runq_pop(struct cpu *c)
+{
+  struct proc *p = 0;
+
+  acquire(&c->rq.lock);
+  for(int q = 0; q < NRUNQ; q++){
+    if((p = c->rq.head[q]) != 0){
+      c->rq.head[q] = p->rqnext;
+      if(c->rq.head[q] == 0)
+        c->rq.tail[q] = 0;
+      c->rq.len--;
+      p->rqnext = 0;
+      break;
+    }
+  }
+  release(&c->rq.lock);
+  return p;
+}
+
+#ifdef SCHED_MLFQ
+// Move every process queued on c back up to its best level,
+// so that CPU-bound processes are not starved forever by
+// interactive ones.
+// Called only by c's own scheduler.
+static void
+runq_boost(struct cpu *c)
+{
+  struct proc *p, *next, *list, **tail;
+  int n = 0;
+
+  // p->prio is guarded by p->lock, which nests outside the
+  // run queue lock, so take the lower levels off the queue
+  // first and put each process back with its lock held.
+  list = 0;
+  tail = &list;
+  acquire(&c->rq.lock);
+  for(int q = 1; q < NRUNQ; q++){
+    if(c->rq.head[q] == 0)
+      continue;
+    *tail = c->rq.head[q];
+    tail = &c->rq.tail[q]->rqnext;
+    for(p = c->rq.head[q]; p; p = p->rqnext)
+      n++;
+    c->rq.head[q] = c->rq.tail[q] = 0;
+  }
+  c->rq.len -= n;
+  release(&c->rq.lock);
+
+  for(p = list; p; p = next){
+    next = p->rqnext;
+    acquire(&p->lock);
+    p->prio = p->nice;
+    acquire(&c->rq.lock);
+    runq_append(&c->rq, p);
+    c->rq.len++;
+    release(&c->rq.lock);
+    release(&p->lock);
+  }
+}
+#endif
+
+// Look for a cpu whose run queue holds at least min more
+// processes than c's and take the process at its head.
+// Victims are tried round-robin starting after c so that
+// idle cpus spread out over the busy ones. Returns 0 if
+// no queue qualified or the victim drained under us.
+static struct proc*
+runq_steal(struct cpu *c, int min)
+{
+  struct cpu *v;
+  struct proc *p;
+  int id = c - cpus;
+
+  for(int i = 1; i < NCPU; i++){
+    v = &cpus[(id + i) % NCPU];
+    if(!cpu_online(v))
+      continue;
+    // Unlocked peek so that an idle cpu doesn't bounce
+    // the lock of every queue on each pass.
+    if(v->rq.len < c->rq.len + min)
+      continue;
+    if((p = runq_pop(v)) != 0){
+      c->nsteal++;
+      return p;
+    }
+  }
+  return 0;
+}
+
+// The online cpu with the shortest run queue, for placing
+// new processes. The lengths are read without locks, so
+// this is only a hint.
+static struct cpu*
+runq_idlest(void)
+{
+  struct cpu *c, *best = &cpus[0];  // hart 0 always comes up
+
+  for(c = cpus; c < &cpus[NCPU]; c++)
+    if(cpu_online(c) && c->rq.len < best->rq.len)
+      best = c;
+  return best;
+}
+
+// Mark p RUNNABLE and queue it on the cpu it last ran on.
+// Caller must hold p->lock.
+static void
+setrunnable(struct proc *p)
+{
+  p->state = RUNNABLE;
+  runq_push(&cpus[p->cpu], p);
+}
+
+// The wait queue for sleepers on chan.
+static struct waitq*
+waitq_for(void *chan)
+{
+  uint64 h = (uint64)chan;
+
+  // Channels are kernel addresses, so the low bits carry
+  // little information; fold in the page number as well.
+  h = (h >> 3) ^ (h >> 12);
+  return &waitq[h % NWAITQ];
+}
+
+// Add p to the head of wq.
+// Caller must hold wq->lock.
+static void
+waitq_insert(struct waitq *wq, struct proc *p)
+{
+  p->wq = wq;
+  p->wqprev = 0;
+  p->wqnext = wq->head;
+  if(wq->head)
+    wq->head->wqprev = p;
+  wq->head = p;
+}
+
+// Unlink p from the wait queue that holds it.
+// Caller must hold p->wq->lock.
+static void
+waitq_unlink(struct proc *p)
+{
+  struct waitq *wq = p->wq;
+
+  if(p->wqprev)
+    p->wqprev->wqnext = p->wqnext;
+  else
+    wq->head = p->wqnext;
+  if(p->wqnext)
+    p->wqnext->wqprev = p->wqprev;
+  p->wqnext = p->wqprev = 0;
+  p->wq = 0;
+  p->chan = 0;
+}
+
+// Take p off its wait queue if it is still on one, as
+// when kill() woke it. Must be called without p->lock,
+// which nests inside the wait queue locks.
+static void
+waitq_remove(struct proc *p)
+{
+  struct waitq *wq = p->wq;
+
+  if(wq == 0)
+    return;
+  acquire(&wq->lock);
+  if(p->wq == wq)
+    waitq_unlink(p);
+  release(&wq->lock);
+}
+
+// Add p to the pid hash under its (new) pid.
+// Caller must not hold p->lock, which nests
+// inside the bucket lock.
+static void
+pidhash_insert(struct proc *p)
+{
+  struct pidhash *h = &pidhash[p->pid % NPIDHASH];
+
+  acquire(&h->lock);
+  p->pidnext = h->head;
+  h->head = p;
+  release(&h->lock);
+}
+
+// Remove p from the pid hash.
+// Caller must not hold p->lock.
+static void
+pidhash_remove(struct proc *p)
+{
+  struct pidhash *h = &pidhash[p->pid % NPIDHASH];
+  struct proc **pp;
+
+  acquire(&h->lock);
+  for(pp = &h->head; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  p->pidnext = 0;
+  release(&h->lock);
+}
+
+// Add p to the group hash under p->pgid.
+// Caller must not hold p->lock.
+static void
+pgrp_insert(struct proc *p)
+{
+  struct pidhash *h = &pgrphash[p->pgid % NPIDHASH];
+
+  acquire(&h->lock);
+  p->pgprev = 0;
+  p->pgnext = h->head;
+  if(h->head)
+    h->head->pgprev = p;
+  h->head = p;
+  release(&h->lock);
+}
+
+// Take p out of the group hash, if it is in it.
+// Caller must not hold p->lock.
+static void
+pgrp_remove(struct proc *p)
+{
+  struct pidhash *h = &pgrphash[p->pgid % NPIDHASH];
+
+  if(p->pgid == 0)
+    return;
+  acquire(&h->lock);
+  if(p->pgprev)
+    p->pgprev->pgnext = p->pgnext;
+  else
+    h->head = p->pgnext;
+  if(p->pgnext)
+    p->pgnext->pgprev = p->pgprev;
+  p->pgnext = p->pgprev = 0;
+  release(&h->lock);
+}
+
+// Look up a process by pid. Returns it with p->lock
+// held, or 0 if no such process exists.
+struct proc*
+findproc(int pid)
+{
+  struct pidhash *h;
+  struct proc *p;
+
+  if(pid <= 0)
+    return 0;
+  h = &pidhash[pid % NPIDHASH];
+  acquire(&h->lock);
+  for(p = h->head; p; p = p->pidnext)
+    if(p->pid == pid)
+      break;
+
+  // The descriptor can't go back to the slab while it is
+  // still in the bucket, but it may already be reaped.
+  if(p){
+    acquire(&p->lock);
+    if(p->state == UNUSED){
+      release(&p->lock);
+      p = 0;
+    }
+  }
+  release(&h->lock);
+  return p;
+}
+
 int
 allocpid()
 {
@@ -115,33 +526,30 @@ allocpid()
   return pid;
 }
 
-// Look in the process table for an UNUSED proc.
-// If found, initialize state required to run in the kernel,
-// and return with p->lock held.
-// If there are no free procs, or a memory allocation fails, return 0.
+// Allocate a new proc from the slab, initialize state
+// required to run in the kernel, and return with p->lock held.
+// If a memory allocation fails, return 0.
 static struct proc*
 allocproc(void)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    acquire(&p->lock);
-    if(p->state == UNUSED) {
-      goto found;
-    } else {
-      release(&p->lock);
-    }
-  }
-  return 0;
+  if((p = slaballoc(&procslab)) == 0)
+    return 0;
 
-found:
+  // Nobody else can see p until it is in the pid hash,
+  // so it can be set up without holding its lock.
+  memset(p, 0, sizeof(*p));
+  initlock(&p->lock, "proc");
   p->pid = allocpid();
   p->state = USED;
 
-  // Allocate a trapframe page and signal stack
-  if(!(p->trapframe = (struct trapframe *)kalloc()) || !(p->signaling.stack = kalloc())) {
+  // Allocate a kernel stack and trapframe page. The signal
+  // stack waits until a handler is installed.
+  if(!(p->kstack = kstackalloc()) ||
+     !(p->trapframe = (struct trapframe *)kalloc())) {
     freeproc(p);
-    release(&p->lock);
+    slabfree(&procslab, p);
     return 0;
   }
   
@@ -149,7 +557,7 @@ found:
   p->pagetable = proc_pagetable(p);
   if(p->pagetable == 0){
     freeproc(p);
-    release(&p->lock);
+    slabfree(&procslab, p);
     return 0;
   }
   
@@ -159,30 +567,52 @@ found:
   p->context.ra = (uint64)forkret;
   p->context.sp = p->kstack + PGSIZE;
 
-  #define CATCHABLE_SIGNAL(name, handler) \
+  sigreset(p);
+
+  p->alarm_timer.fn = alarmtimer;
+  p->alarm_timer.arg = p;
+
+  pidhash_insert(p);
+  acquire(&p->lock);
+  return p;
+}
+
+// Give p the default signal handlers, as for a new
+// program, abandoning any handler that is running.
+void
+sigreset(struct proc *p)
+{
+  #define CATCHABLE_SIGNAL(name, handler, mode) \
     p->signaling.handlers[SIGNAL_##name] = (signal_handler_t)SIGNAL_HANDLER_##handler;
-  #define UNCATCHABLE_SIGNAL(name)
+  #define UNCATCHABLE_SIGNAL(name, mode)
   SIGNALS
   #undef CATCHABLE_SIGNAL
   #undef UNCATCHABLE_SIGNAL
-
-  return p;
+  p->signaling.batch = 0;
+  p->signaling.in_handler = 0;
+  p->signaling.altstack = 0;
+  p->signaling.altsize = 0;
 }
 
-// free a proc structure and the data hanging from it,
-// including user pages.
-// p->lock must be held.
+// free the data hanging from a proc structure,
+// including user pages and its kernel stack, and
+// mark it UNUSED. The descriptor itself stays in the
+// pid hash until putproc().
+// p->lock must be held, unless p was never published.
 static void
 freeproc(struct proc *p)
 {
+  if(p->kstack) kstackfree(p->kstack);
+  p->kstack = 0;
   if(p->trapframe) kfree((void*)p->trapframe);
   p->trapframe = 0;
-  if(p->signaling.stack) kfree(p->signaling.stack);
-  p->signaling.stack = 0;
-  if(p->pagetable) proc_freepagetable(p->pagetable, p->sz);
+  if(p->pagetable){
+    sigstackfree(p, p->pagetable);
+    mchanclose(p, p->pagetable);
+    proc_freepagetable(p->pagetable, p->sz);
+  }
   p->pagetable = 0;
   p->sz = 0;
-  p->pid = 0;
   p->parent = 0;
   p->name[0] = 0;
   p->chan = 0;
@@ -191,6 +621,28 @@ freeproc(struct proc *p)
   p->state = UNUSED;
 }
 
+// Give a descriptor released by freeproc() back to the slab,
+// with any signals still queued to it. Once p is out of the
+// pid and group hashes and its timers are stopped, nobody
+// can send more.
+// Caller must not hold p->lock.
+static void
+putproc(struct proc *p)
+{
+  struct sigentry *e;
+
+  timer_del(&p->sleep_timer);
+  hrtimer_del(&p->alarm_timer);
+  pidhash_remove(p);
+  pgrp_remove(p);
+  sigdrain(p);
+  while((e = p->signaling.head) != 0){
+    p->signaling.head = e->next;
+    slabfree(&sigslab, e);
+  }
+  slabfree(&procslab, p);
+}
+
 // Create a user page table for a given process, with no user memory,
 // but with trampoline, trapframe, and signaling pages.
 pagetable_t
@@ -231,16 +683,6 @@ proc_pagetable(struct proc *p)
     return 0;
   }
   
-  // map the signal stack in signal.S to the page under ret
-  if(mappages(pagetable, SIGNALSTACK, PGSIZE,
-              (uint64)(p->signaling.stack), PTE_R | PTE_W | PTE_U) < 0){
-    uvmunmap(pagetable, TRAMPOLINE, 1, 0);
-    uvmunmap(pagetable, TRAPFRAME, 1, 0);
-    uvmunmap(pagetable, SIGNALRET, 1, 0);
-    uvmfree(pagetable, 0);
-    return 0;
-  }
-  
   return pagetable;
 }
 
@@ -252,7 +694,6 @@ proc_freepagetable(pagetable_t pagetable, uint64 sz)
   uvmunmap(pagetable, TRAMPOLINE, 1, 0);
   uvmunmap(pagetable, TRAPFRAME, 1, 0);
   uvmunmap(pagetable, SIGNALRET, 1, 0);
-  uvmunmap(pagetable, SIGNALSTACK, 1, 0);
   uvmfree(pagetable, sz);
 }
 
@@ -290,9 +731,13 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  p->cpu = 0;
+  setrunnable(p);
 
   release(&p->lock);
+
+  p->pgid = p->pid;
+  pgrp_insert(p);
 }
 
 // Grow or shrink user memory by n bytes.
@@ -305,6 +750,8 @@ growproc(int n)
 
   sz = p->sz;
   if(n > 0){
+    if(sz + n > MCHAN(NPMCHAN-1) || sz + n < sz)
+      return -1;
     if((sz = uvmalloc(p->pagetable, sz, sz + n, PTE_W)) == 0) {
       return -1;
     }
@@ -333,6 +780,7 @@ fork(void)
   if(uvmcopy(p->pagetable, np->pagetable, p->sz) < 0){
     freeproc(np);
     release(&np->lock);
+    putproc(np);
     return -1;
   }
   np->sz = p->sz;
@@ -355,12 +803,64 @@ fork(void)
 
   release(&np->lock);
 
+  // Children start out in their parent's group.
+  np->pgid = p->pgid;
+  pgrp_insert(np);
+
   acquire(&wait_lock);
   np->parent = p;
+  np->sibling = p->children;
+  p->children = np;
   release(&wait_lock);
 
   acquire(&np->lock);
-  np->state = RUNNABLE;
+  np->nice = np->prio = p->nice;
+  np->cpu = runq_idlest() - cpus;
+  setrunnable(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Start a kernel thread that calls fn(arg) with pagetable
+// as its user address space, for copyin() and copyout().
+// The caller owns pagetable, and fn must not return before
+// it is done with it. The thread then exits, to be reaped
+// by init. Returns its pid, or -1.
+int
+kthread(char *name, void (*fn)(void*), void *arg, pagetable_t pagetable)
+{
+  int pid;
+  struct proc *np;
+  struct proc *p = myproc();
+
+  if((np = allocproc()) == 0)
+    return -1;
+
+  // It never returns to user space, so needs no trampoline.
+  proc_freepagetable(np->pagetable, 0);
+  np->pagetable = pagetable;
+  np->sz = 0;
+  np->kfn = fn;
+  np->karg = arg;
+  np->context.ra = (uint64)kthreadret;
+  np->cwd = idup(p->cwd);
+  safestrcpy(np->name, name, sizeof(np->name));
+
+  pid = np->pid;
+
+  release(&np->lock);
+
+  acquire(&wait_lock);
+  np->parent = initproc;
+  np->sibling = initproc->children;
+  initproc->children = np;
+  release(&wait_lock);
+
+  acquire(&np->lock);
+  np->nice = np->prio = p->nice;
+  np->cpu = runq_idlest() - cpus;
+  setrunnable(np);
   release(&np->lock);
 
   return pid;
@@ -371,14 +871,18 @@ fork(void)
 void
 reparent(struct proc *p)
 {
-  struct proc *pp;
-
-  for(pp = proc; pp < &proc[NPROC]; pp++){
-    if(pp->parent == p){
-      pp->parent = initproc;
-      wakeup(initproc);
-    }
+  struct proc *pp, *next;
+
+  if(p->children == 0)
+    return;
+  for(pp = p->children; pp; pp = next){
+    next = pp->sibling;
+    pp->parent = initproc;
+    pp->sibling = initproc->children;
+    initproc->children = pp;
   }
+  p->children = 0;
+  wakeup(initproc);
 }
 
 // Exit the current process.  Does not return.
@@ -392,6 +896,12 @@ exit(int status)
   if(p == initproc)
     panic("init exiting");
 
+  // Cancel its I/O, and stop its alarms, which would
+  // otherwise keep firing at a zombie. putproc() cancels
+  // the timer again in case an exit never got this far.
+  aiodrain(p);
+  setitimer(p, 0, 0);
+
   // Close all open files.
   for(int fd = 0; fd < NOFILE; fd++){
     if(p->ofile[fd]){
@@ -426,78 +936,42 @@ exit(int status)
   panic("zombie exit");
 }
 
-// This is a reduced exit() for exiting from a signal,
-// since the proc is already locked and we won't be
-// switching to the scheduler (we're already in it!)
-void
-exit_from_signal(int status, struct proc *p)
-{
-  if(p == initproc) panic("init exiting");
-  
-  // Close all open files.
-  for(int fd = 0; fd < NOFILE; fd++){
-    if(p->ofile[fd]){
-      struct file *f = p->ofile[fd];
-      fileclose(f);
-      p->ofile[fd] = 0;
-    }
-  }
-
-  begin_op();
-  iput(p->cwd);
-  end_op();
-  p->cwd = 0;
-
-  acquire(&wait_lock);
-
-  // Give any children to init.
-  reparent(p);
-
-  // Parent might be sleeping in wait().
-  wakeup(p->parent);
-  
-  p->xstate = status;
-  p->state = ZOMBIE;
-
-  release(&wait_lock);
-}
-
 // Wait for a child process to exit and return its pid.
 // Return -1 if this process has no children.
 int
 wait(uint64 addr)
 {
-  struct proc *pp;
+  struct proc *pp, **link;
   int havekids, pid;
   struct proc *p = myproc();
 
   acquire(&wait_lock);
 
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(pp = proc; pp < &proc[NPROC]; pp++){
-      if(pp->parent == p){
-        // make sure the child isn't still in exit() or swtch().
-        acquire(&pp->lock);
-
-        havekids = 1;
-        if(pp->state == ZOMBIE){
-          // Found one.
-          pid = pp->pid;
-          if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
-                                  sizeof(pp->xstate)) < 0) {
-            release(&pp->lock);
-            release(&wait_lock);
-            return -1;
-          }
-          freeproc(pp);
+    for(link = &p->children; (pp = *link) != 0; link = &pp->sibling){
+      // make sure the child isn't still in exit() or swtch().
+      acquire(&pp->lock);
+
+      havekids = 1;
+      if(pp->state == ZOMBIE){
+        // Found one.
+        pid = pp->pid;
+        if(addr != 0 && copyout(p->pagetable, addr, (char *)&pp->xstate,
+                                sizeof(pp->xstate)) < 0) {
           release(&pp->lock);
           release(&wait_lock);
-          return pid;
+          return -1;
         }
+        *link = pp->sibling;
+        freeproc(pp);
         release(&pp->lock);
+        release(&wait_lock);
+        putproc(pp);
+        return pid;
       }
+      release(&pp->lock);
     }
 
     // No point waiting if we don't have any children.
@@ -525,112 +999,186 @@ SIGNAL_HANDLER(signal_handler_KILL) {
   return -1;
 }
 
-// Returns 1 if the process is no longer runnable
-int handle_signals(void *kstack, struct proc *p) {
-  struct cpu *c = mycpu();
-  int cid = cpuid(); (void)cid;
-  int killed = 0;
-  
-  p->signaling.in_handler = 1;
-  
-  if(p->signaling.count) {
-    // Back up old versions of the trapframe, context, and stacks
-    // so we can return to the main process seamlessly
-    struct trapframe tf = *p->trapframe;
-    struct context ctx = p->context;
-    uint64 old_kstack = p->kstack;
-    p->kstack = (uint64)kstack;
-    
-    DEBUG_PROC_PRINT("(%d:%d) Entering signaling loop\n", cid, p->pid);
-    
-    while(p->signaling.count > 0) {
-      // Pop the signal from the queue
-      signal_t signal = p->signaling.queue[p->signaling.read];
-      p->signaling.read = (p->signaling.read+1) % MAX_SIGNALS;
-      p->signaling.count--;
-      DEBUG_PROC_PRINT("(%d:%d) Handling Signal ID %d\n", cid, p->pid, signal.type);
-      
-      int result = 0;
-      if(signal.type < SIGNAL_CATCHABLE_COUNT) {
-        // If we can catch the signal, it can have a custom handler
-        // So, we check if it's a predefined handler or a custom one
-        switch((uint64)p->signaling.handlers[signal.type]) {
-          case (uint64)SIGNAL_HANDLER_IGNORE: result = signal_handler_ignore(signal); break;
-          case (uint64)SIGNAL_HANDLER_TERMINATE: result = signal_handler_terminate(signal); break;
-          default: {
-            // This signal has a custom handler, so we need to jump into
-            // usermode to handle it. We'll hijack the yield function to
-            // release the lock and jump into usertrapret, which will
-            // have a modified trapframe to jump into the handler.
-            //
-            // When the handler returns, it'll yield back into the
-            // scheduler so that other signals can be handled.
-            
-            // Reset and use the dummy kernel stack
-            memmove(kstack, (void*)old_kstack, PGSIZE);
-            p->context.sp = (uint64)kstack + (p->context.sp - old_kstack);
-            
-            // Reset the signal stack
-            memset(p->signaling.stack, 0, PGSIZE);
-            
-            // Set up the trapframe to point to the handler
-            *p->trapframe = (struct trapframe){
-              .epc = (uint64)p->signaling.handlers[signal.type],
-              .ra = (uint64)SIGNALRET,
-              .sp = (uint64)SIGNALSTACK+PGSIZE,
-              .gp = tf.gp,
-              .a0 = ((uint64)signal.sender_pid << 32) | signal.type,
-              .a1 = signal.payload,
-            };
-            
-            // Hijack yield to return to usermode
-            swtch(&c->context, &p->context);
-            
-            if(p->state == RUNNABLE) {
-              // yield sets state to runnable.
-              p->state = RUNNING;
-              result = p->trapframe->a0;
-            } else if(p->state == SLEEPING) {
-              // We don't want to sleep in signal handlers, as it would
-              // greatly complicate resuming, so we'll just kill it if
-              // that happens.
-              result = -1;
-            }
-            
-            p->context = ctx;
+// Copy first, then up to SIGBATCH-1 more pending signals of
+// its type, to the vector at user address v. Returns the
+// count, or -1 if v isn't writable.
+static int
+sigcollect(struct proc *p, signal_t first, uint64 v)
+{
+  struct sigentry *e, *prev, *next, *done;
+  int n = 0, bad;
+
+  bad = copyout(p->pagetable, v, (char*)&first, sizeof(first)) < 0;
+  n++;
+  done = 0;
+  prev = 0;
+  sigdrain(p);
+  for(e = p->signaling.head; e && n < SIGBATCH; e = next){
+    next = e->next;
+    if(e->signal.type != first.type){
+      prev = e;
+      continue;
+    }
+    if(prev)
+      prev->next = next;
+    else
+      p->signaling.head = next;
+    if(p->signaling.tail == e)
+      p->signaling.tail = prev;
+    __atomic_fetch_sub(&p->signaling.count, 1, __ATOMIC_RELAXED);
+    if(copyout(p->pagetable, v + n * sizeof(signal_t),
+               (char*)&e->signal, sizeof(signal_t)) < 0)
+      bad = 1;
+    n++;
+    e->next = done;
+    done = e;
+  }
+
+  for(e = done; e; e = next){
+    next = e->next;
+    slabfree(&sigslab, e);
+  }
+  return bad ? -1 : n;
+}
+
+// Act on p's pending signals on its way back to user space;
+// called by usertrapret(). A custom handler is entered by
+// pointing the trapframe at it, after saving the interrupted
+// registers at the top of the signal stack for sigreturn().
+// Handlers run one at a time, but a batch handler takes all
+// pending signals of its type in a single call.
+void
+deliver_signals(void)
+{
+  struct proc *p = myproc();
+  struct sigentry *e;
+  signal_handler_t handler;
+  signal_t signal;
+  struct trapframe tf;
+  uint64 top, sf, v;
+  int result, pending, type, n;
+
+  for(;;){
+    if(!sigpending(p))
+      return;
+    pending = __atomic_load_n(&p->signaling.pending, __ATOMIC_ACQUIRE);
+    if(pending){
+      // Uncatchable types come last, so they go first.
+      type = SIGNAL_COUNT;
+      while(!(pending & (1 << type)))
+        type--;
+      // Clear the bit before taking the count: a send that
+      // lands in between is counted now, and the bit it sets
+      // again is skipped below.
+      __atomic_fetch_and(&p->signaling.pending, ~(1 << type), __ATOMIC_ACQ_REL);
+      n = __atomic_exchange_n(&p->signaling.nsent[type], 0, __ATOMIC_ACQ_REL);
+      if(n == 0)
+        continue;
+      signal = (signal_t){
+        .type = type,
+        .sender_pid = p->signaling.sender[type],
+        .payload = n,
+      };
+    } else {
+      e = p->signaling.head;
+      if((p->signaling.head = e->next) == 0)
+        p->signaling.tail = 0;
+      __atomic_fetch_sub(&p->signaling.count, 1, __ATOMIC_RELAXED);
+      signal = e->signal;
+      slabfree(&sigslab, e);
+    }
+    DEBUG_PROC_PRINT("(%d:%d) Handling Signal ID %d\n", cpuid(), p->pid, signal.type);
+
+    result = 0;
+    if(signal.type < SIGNAL_CATCHABLE_COUNT) {
+      // If we can catch the signal, it can have a custom handler
+      // So, we check if it's a predefined handler or a custom one
+      handler = p->signaling.handlers[signal.type];
+      switch((uint64)handler) {
+        case (uint64)SIGNAL_HANDLER_IGNORE: result = signal_handler_ignore(signal); break;
+        case (uint64)SIGNAL_HANDLER_TERMINATE: result = signal_handler_terminate(signal); break;
+        default:
+          // Run the handler in user mode on the signal stack,
+          // after saving the interrupted registers at its top.
+          // It returns to SIGNALRET, which calls sigreturn().
+          if(p->signaling.altsize)
+            top = p->signaling.altstack + p->signaling.altsize;
+          else if(sigstackmap(p) == 0)
+            top = SIGNALSTACK + PGSIZE;
+          else
+            exit(-1);
+          // Only the user registers go out; sigreturn() takes
+          // the kernel_* fields from the live trapframe.
+          tf = *p->trapframe;
+          tf.kernel_satp = tf.kernel_sp = tf.kernel_trap = tf.kernel_hartid = 0;
+          sf = (top - sizeof(tf)) & ~15L;
+          if(copyout(p->pagetable, sf, (char*)&tf, sizeof(tf)) < 0)
+            exit(-1);
+          p->signaling.frame = sf;
+          p->trapframe->epc = (uint64)handler;
+          p->trapframe->ra = SIGNALRET;
+          if(p->signaling.batch & (1 << signal.type)){
+            // Pass the vector just below the saved frame.
+            v = sf - SIGBATCH * sizeof(signal_t);
+            if((n = sigcollect(p, signal, v)) < 0)
+              exit(-1);
+            p->trapframe->a1 = n;
+            p->trapframe->sp = v;
+            p->trapframe->a0 = v;
+          } else {
+            p->trapframe->sp = sf;
+            p->trapframe->a0 = ((uint64)signal.sender_pid << 32) | signal.type;
+            p->trapframe->a1 = signal.payload;
           }
-        }
-      } else {
-        // We can't catch the signal, so we'll call its dedicated
-        // handler.
-        switch(signal.type) {
-          #define CATCHABLE_SIGNAL(...)
-          #define UNCATCHABLE_SIGNAL(name) \
-          case SIGNAL_##name: result = signal_handler_##name(signal); break;
-          SIGNALS
-          #undef UNCATCHABLE_SIGNAL
-          #undef CATCHABLE_SIGNAL
-        }
+          p->signaling.in_handler = 1;
+          return;
+      }
+    } else {
+      // We can't catch the signal, so we'll call its dedicated
+      // handler.
+      switch(signal.type) {
+        #define CATCHABLE_SIGNAL(...)
+        #define UNCATCHABLE_SIGNAL(name, mode) \
+        case SIGNAL_##name: result = signal_handler_##name(signal); break;
+        SIGNALS
+        #undef UNCATCHABLE_SIGNAL
+        #undef CATCHABLE_SIGNAL
       }
-      
-      // Nonzero handler results indicate an error, so we terminate
-      // the process if that happens. Also, if it's been killed, we
-      // don't care about handling any other signals.
-      DEBUG_PROC_PRINT("(%d:%d) Post-Signal\n", cid, p->pid);
-      if(result) exit_from_signal(result, p);
-      killed = p->killed || p->state == ZOMBIE;
-      if(killed) break;
     }
-    
-    // Reset the backed up data before returning to the scheduler
-    DEBUG_PROC_PRINT("(%d:%d) Exiting signaling loop\n", cid, p->pid);
-    *p->trapframe = tf;
-    p->kstack = old_kstack;
+
+    // Nonzero handler results indicate an error, so we terminate
+    // the process if that happens.
+    if(result)
+      exit(result);
   }
-  
+}
+
+// Return from a custom signal handler, whose result is in a0.
+// A nonzero result terminates the process; otherwise the
+// registers saved by deliver_signals() are restored.
+uint64
+sigreturn(void)
+{
+  struct proc *p = myproc();
+  struct trapframe sf;
+  int result = p->trapframe->a0;
+
+  if(!p->signaling.in_handler)
+    return -1;
+  if(result)
+    exit(result);
+  // The frame is in user memory, so take only the user
+  // registers from it; its kernel_* fields are zero anyway.
+  if(copyin(p->pagetable, (char*)&sf, p->signaling.frame, sizeof(sf)) < 0)
+    exit(-1);
+  sf.kernel_satp = p->trapframe->kernel_satp;
+  sf.kernel_sp = p->trapframe->kernel_sp;
+  sf.kernel_trap = p->trapframe->kernel_trap;
+  sf.kernel_hartid = p->trapframe->kernel_hartid;
+  *p->trapframe = sf;
   p->signaling.in_handler = 0;
-  
-  return killed;
+  // syscall() stores this in a0, which must survive.
+  return p->trapframe->a0;
 }
 
 // Per-CPU process scheduler.
@@ -645,69 +1193,99 @@ scheduler(void)
 {
   struct proc *p;
   struct cpu *c = mycpu();
-  int cid = cpuid(); (void)cid;
-  
-  // Dummy kernel stack to not corrupt the main one
-  void *kstack = kalloc();
-  if(!kstack) panic("scheduler kstack");
-  
-  // Number of processes that were scheduled in one loop, to know
-  // whether we should call 'wfi'.
-  int num_run = 0;
+  int cid = cpuid();
   
   c->proc = 0;
   for(;;){
     // Avoid deadlock by ensuring that devices can interrupt.
     intr_on();
-    num_run = 0;
 
-    for(p = proc; p < &proc[NPROC]; p++) {
-      acquire(&p->lock);
-      
-      if(p->state == RUNNABLE) {
-        // Switch to chosen process.  It is the process's job
-        // to release its lock and then reacquire it
-        // before jumping back to us.
-        num_run++;
-        p->state = RUNNING;
-        c->proc = p;
-
-        uint64 local_ticks = ticks;
-        if (p->alarm_set && p->cycles_at_alarm >= local_ticks) {
-          p->alarm_set = 0;
-          send_signal((signal_t){.type=SIGNAL_ALARM, .sender_pid=p->pid}, p->pid);
-        }
-        
-        // acquire(&tickslock);
-        // int localticks = ticks;
-        // release(&tickslock);
-        // if (p->alarm_set && p->ticks_at_alarm >= localticks) {
-        //   p->alarm_set = 0;
-        //   send_signal((signal_t){.type=SIGNAL_ALARM, .sender_pid=p->pid}, p->pid);
-        // }
-        
-        // Go and process any queued signals
-        if(!handle_signals(kstack, p)) {
-          // Actually run the process
-          DEBUG_PROC_PRINT("(%d:%d) Scheduling to %p\n", cid, p->pid, p->context.ra);
-          swtch(&c->context, &p->context);
-        }
-        
-        
-        // Process is done running for now.
-        // It should have changed its p->state before coming back.
-        c->proc = 0;
+#ifdef SCHED_MLFQ
+    if(ticks - c->boosted >= MLFQ_BOOST){
+      c->boosted = ticks;
+      runq_boost(c);
+    }
+#endif
+
+    // Only queued processes are candidates, so an idle
+    // table costs nothing to schedule. A busy cpu pulls
+    // from a much longer queue to even out load, and an
+    // idle one steals anything waiting elsewhere before
+    // sleeping until an IPI says there is new work.
+    p = 0;
+    if(c->rq.len > 0)
+      p = runq_steal(c, STEAL_BUSY);
+    if(p == 0)
+      p = runq_pop(c);
+    if(p == 0)
+      p = runq_steal(c, STEAL_IDLE);
+    // With nothing to run, zero a page for kzalloc() and
+    // look again, until there is no more zeroing to do.
+    if(p == 0 && kzerofill())
+      continue;
+    if(p == 0){
+      // Announce that we are going idle, then look once
+      // more, so that a racing runq_push() either is seen
+      // here or sees inwfi and sends an IPI. Interrupts
+      // stay off so that the IPI is still pending at wfi.
+      intr_off();
+      c->inwfi = 1;
+      __sync_synchronize();
+      if((p = runq_pop(c)) == 0 && (p = runq_steal(c, STEAL_IDLE)) == 0){
+        uint64 t0 = r_time();
+        __wfi();
+        c->idle += r_time() - t0;
       }
-      
-      release(&p->lock);
+      c->inwfi = 0;
+      if(p == 0)
+        continue;
     }
 
-    if (!num_run) {
-      __wfi();
+    // The process may still be switching out on the cpu
+    // that queued it; its lock is held until that is done.
+    acquire(&p->lock);
+    if(p->state == RUNNABLE) {
+      // Switch to chosen process.  It is the process's job
+      // to release its lock and then reacquire it
+      // before jumping back to us.
+      p->state = RUNNING;
+      c->proc = p;
+      if(p->cpu != cid){
+        c->nmigrate++;
+        p->cpu = cid;
+      }
+      uint g = __atomic_load_n(&kstacks.gen, __ATOMIC_ACQUIRE);
+      if(c->kgen != g){
+        // p's stack may sit in a slot this hart last saw
+        // mapped to another page.
+        sfence_vma();
+        c->kgen = g;
+      }
+      uint64 now = r_time();
+      p->waittime += now - p->tstamp;
+      p->tstamp = now;
+      p->nswtch++;
+      c->nswtch++;
+      // An idle cpu stopped ticking; it needs
+      // ticks again to preempt p.
+      if(!c->ticking)
+        clockarm();
+
+      DEBUG_PROC_PRINT("(%d:%d) Scheduling to %p\n", cid, p->pid, p->context.ra);
+      swtch(&c->context, &p->context);
+
+      // Process is done running for now.
+      // It should have changed its p->state before coming back.
+      // A run queue push has already stamped it.
+      uint64 end = r_time();
+      p->runtime += end - now;
+      if(p->state != RUNNABLE)
+        p->tstamp = end;
+      c->proc = 0;
     }
+    
+    release(&p->lock);
   }
-  
-  kfree(kstack);
 }
 
 // Switch to scheduler.  Must hold only p->lock
@@ -717,11 +1295,19 @@ scheduler(void)
 // be proc->intena and proc->noff, but that would
 // break in the few places where a lock is held but
 // there's no process.
+// A switch through sched() counts as voluntary.
 void
 sched(void)
+{
+  swtchout(myproc(), 0);
+}
+
+// The body of sched(), counting the switch as voluntary
+// or not right where it happens.
+static void
+swtchout(struct proc *p, int preempted)
 {
   int intena;
-  struct proc *p = myproc();
 
   if(!holding(&p->lock))
     panic("sched p->lock");
@@ -732,6 +1318,11 @@ sched(void)
   if(intr_get())
     panic("sched interruptible");
 
+  if(preempted)
+    p->nivcsw++;
+  else
+    p->nvcsw++;
+
   DEBUG_PROC_PRINT("(%d:%d) Entering sched\n", cpuid(), p->pid);
   intena = mycpu()->intena;
   swtch(&p->context, &mycpu()->context);
@@ -746,12 +1337,48 @@ yield(void)
   struct proc *p = myproc();
   acquire(&p->lock);
   p->state = RUNNABLE;
+  runq_push(mycpu(), p);
   DEBUG_PROC_PRINT("(%d:%d) Yielding\n", cpuid(), p->pid);
   sched();
   DEBUG_PROC_PRINT("(%d:%d) Post-Yielding\n", cpuid(), p->pid);
   release(&p->lock);
 }
 
+// Give up the CPU because of a timer interrupt. Under
+// MLFQ, using up a whole time slice costs the process
+// a priority level.
+void
+preempt(void)
+{
+  struct proc *p = myproc();
+
+  acquire(&p->lock);
+#ifdef SCHED_MLFQ
+  if(p->prio < NPRIO - 1)
+    p->prio++;
+#endif
+  p->state = RUNNABLE;
+  runq_push(mycpu(), p);
+  swtchout(p, 1);
+  release(&p->lock);
+}
+
+// A kernel thread's first scheduling swtches here.
+static void
+kthreadret(void)
+{
+  struct proc *p = myproc();
+
+  // Still holding p->lock from scheduler.
+  release(&p->lock);
+
+  p->kfn(p->karg);
+
+  // The page table belongs to whoever started us.
+  p->pagetable = 0;
+  exit(0);
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch to forkret.
 void
@@ -773,41 +1400,114 @@ forkret(void)
   usertrapret();
 }
 
+// Move signals senders have pushed onto p's inbox to the end
+// of its queue, oldest first. Only p itself, or putproc()
+// once no sender is left, takes from the inbox.
+static void
+sigdrain(struct proc *p)
+{
+  struct sigentry *e, *next, *list;
+
+  list = 0;
+  e = __atomic_exchange_n(&p->signaling.inbox, 0, __ATOMIC_ACQUIRE);
+  for(; e; e = next){
+    next = e->next;
+    e->next = list;
+    list = e;
+  }
+  if(list == 0)
+    return;
+  if(p->signaling.tail)
+    p->signaling.tail->next = list;
+  else
+    p->signaling.head = list;
+  for(e = list; e->next; e = e->next)
+    ;
+  p->signaling.tail = e;
+}
+
+// Does p have a signal that deliver_signals() would act on
+// now? Called by p itself.
+static int
+sigpending(struct proc *p)
+{
+  if(p->signaling.in_handler)
+    return 0;
+  sigdrain(p);
+  return p->signaling.head ||
+         __atomic_load_n(&p->signaling.pending, __ATOMIC_ACQUIRE);
+}
+
 // Atomically release lock and sleep on chan.
-// Reacquires lock when awakened. Returns whether
-// the sleep is returning into a signal handler;
-int
-sleep(void *chan, struct spinlock *lk)
+// Reacquires lock when awakened.
+// If intr is set, a pending signal also ends the sleep,
+// or prevents it, and 1 is returned.
+static int
+sleep1(void *chan, struct spinlock *lk, int intr)
 {
   struct proc *p = myproc();
+  struct waitq *wq = waitq_for(chan);
+  int interrupted;
   
-  // Must acquire p->lock in order to
-  // change p->state and then call sched.
-  // Once we hold p->lock, we can be
+  // Must acquire chan's wait queue lock to join
+  // the queue, and p->lock in order to change
+  // p->state and then call sched.
+  // Once we hold the wait queue lock, we can be
   // guaranteed that we won't miss any wakeup
-  // (wakeup locks p->lock),
+  // (wakeup locks the same wait queue),
   // so it's okay to release lk.
 
-  acquire(&p->lock);  //DOC: sleeplock1
+  acquire(&wq->lock);  //DOC: sleeplock1
+  acquire(&p->lock);
+  // Publish intr before looking for signals; a sender posts
+  // before looking at intr (see queue_signal()), so one of
+  // us sees the other.
+  p->intr = intr;
+  __sync_synchronize();
+  if(intr && sigpending(p)){
+    p->intr = 0;
+    release(&p->lock);
+    release(&wq->lock);
+    return 1;
+  }
   release(lk);
 
   // Go to sleep.
   p->chan = chan;
   p->state = SLEEPING;
+  waitq_insert(wq, p);
+  release(&wq->lock);
   
   DEBUG_PROC_PRINT("(%d:%d) Sleeping\n", cpuid(), p->pid);
   sched();
   DEBUG_PROC_PRINT("(%d:%d) Post-Sleeping\n", cpuid(), p->pid);
-  int in_handler = p->signaling.in_handler;
+  interrupted = intr && sigpending(p);
+  p->intr = 0;
   
-  // Tidy up.
-  p->chan = 0;
+  release(&p->lock);
+
+  // Tidy up. wakeup() has normally taken us off
+  // the queue already, but kill() leaves us on it.
+  waitq_remove(p);
 
   // Reacquire original lock.
-  release(&p->lock);
   acquire(lk);
   
-  return in_handler;
+  return interrupted;
+}
+
+void
+sleep(void *chan, struct spinlock *lk)
+{
+  sleep1(chan, lk, 0);
+}
+
+// Like sleep(), but returns 1 early, with lk held, once
+// a signal is waiting to be delivered.
+int
+sleepintr(void *chan, struct spinlock *lk)
+{
+  return sleep1(chan, lk, 1);
 }
 
 // Wake up all processes sleeping on chan.
@@ -815,18 +1515,29 @@ sleep(void *chan, struct spinlock *lk)
 void
 wakeup(void *chan)
 {
-  struct proc *p;
+  struct waitq *wq = waitq_for(chan);
+  struct proc *p, *next;
 
-  for(p = proc; p < &proc[NPROC]; p++) {
-    if(p != myproc()){
-      acquire(&p->lock);
-      if(p->state == SLEEPING && p->chan == chan) {
-        DEBUG_PROC_PRINT("(x:%d) Waking up\n", p->pid);
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
+  acquire(&wq->lock);
+  for(p = wq->head; p; p = next) {
+    next = p->wqnext;
+    if(p->chan != chan || p == myproc())
+      continue;
+    acquire(&p->lock);
+    if(p->state == SLEEPING) {
+      DEBUG_PROC_PRINT("(x:%d) Waking up\n", p->pid);
+#ifdef SCHED_MLFQ
+      // Processes that block before their slice runs out
+      // are interactive; move them up a level.
+      if(p->prio > p->nice)
+        p->prio--;
+#endif
+      setrunnable(p);
     }
+    release(&p->lock);
+    waitq_unlink(p);
   }
+  release(&wq->lock);
 }
 
 // Kill the process with the given pid.
@@ -837,20 +1548,15 @@ kill(int pid)
 {
   struct proc *p;
 
-  for(p = proc; p < &proc[NPROC]; p++){
-    acquire(&p->lock);
-    if(p->pid == pid){
-      p->killed = 1;
-      if(p->state == SLEEPING){
-        // Wake process from sleep().
-        p->state = RUNNABLE;
-      }
-      release(&p->lock);
-      return 0;
-    }
-    release(&p->lock);
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->killed = 1;
+  if(p->state == SLEEPING){
+    // Wake process from sleep().
+    setrunnable(p);
   }
-  return -1;
+  release(&p->lock);
+  return 0;
 }
 
 void
@@ -917,74 +1623,444 @@ procdump(void)
   [ZOMBIE]    "zombie"
   };
   struct proc *p;
+  struct cpu *c;
   char *state;
+  int i;
 
   printf("\n");
-  for(p = proc; p < &proc[NPROC]; p++){
-    if(p->state == UNUSED)
+  for(c = cpus; c < &cpus[NCPU]; c++){
+    if(c->nsteal == 0 && c->nmigrate == 0 && c->rq.len == 0)
       continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
-    else
-      state = "???";
-    printf("%d %s %s", p->pid, state, p->name);
-    printf("\n");
+    printf("cpu %d: queued %d steals %d migrations %d\n",
+           (int)(c - cpus), c->rq.len, c->nsteal, c->nmigrate);
+  }
+  for(i = 0; i < NPIDHASH; i++){
+    for(p = pidhash[i].head; p; p = p->pidnext){
+      if(p->state == UNUSED)
+        continue;
+      if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
+        state = states[p->state];
+      else
+        state = "???";
+      printf("%d %s %s prio %d", p->pid, state, p->name, p->prio);
+      printf("\n");
+    }
+  }
+}
+
+// Set the priority level of process pid, or of the caller
+// if pid is 0. Under MLFQ the process starts again at that
+// level and is never boosted above it; round-robin records
+// it but ignores it. Returns the old level, or -1.
+int
+setpriority(int pid, int prio)
+{
+  struct proc *p;
+  int old;
+
+  if(prio < 0 || prio >= NPRIO)
+    return -1;
+  if(pid == 0)
+    pid = myproc()->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  old = p->nice;
+  p->nice = p->prio = prio;
+  release(&p->lock);
+  return old;
+}
+
+// Copy scheduler statistics out to user space: up to ncpu
+// struct cpustat at ucs and up to nproc struct procstat at
+// ups. Returns the number of processes copied, or -1.
+int
+schedstat(uint64 ucs, int ncpu, uint64 ups, int nproc)
+{
+  struct proc *p, *me = myproc();
+  struct cpustat cs;
+  struct procstat ps;
+  uint64 now;
+  int i, n;
+
+  for(i = 0; i < ncpu && i < NCPU; i++){
+    cs.idle = cpus[i].idle;
+    cs.nswtch = cpus[i].nswtch;
+    cs.queued = cpus[i].rq.len;
+    cs.nsteal = cpus[i].nsteal;
+    cs.nmigrate = cpus[i].nmigrate;
+    if(copyout(me->pagetable, ucs + i*sizeof(cs), (char*)&cs, sizeof(cs)) < 0)
+      return -1;
+  }
+
+  n = 0;
+  for(i = 0; i < NPIDHASH && n < nproc; i++){
+    acquire(&pidhash[i].lock);
+    for(p = pidhash[i].head; p && n < nproc; p = p->pidnext){
+      acquire(&p->lock);
+      if(p->state == UNUSED){
+        release(&p->lock);
+        continue;
+      }
+      ps.pid = p->pid;
+      ps.state = p->state;
+      ps.prio = p->prio;
+      ps.cpu = p->cpu;
+      ps.runtime = p->runtime;
+      ps.waittime = p->waittime;
+      ps.nivcsw = p->nivcsw;
+      ps.nvcsw = p->nvcsw;
+      now = r_time();
+      if(p->state == RUNNING){
+        // Count the current run so far.
+        ps.runtime += now - p->tstamp;
+      } else if(p->state == RUNNABLE){
+        ps.waittime += now - p->tstamp;
+      }
+      safestrcpy(ps.name, p->name, sizeof(ps.name));
+      release(&p->lock);
+      if(copyout(me->pagetable, ups + n*sizeof(ps), (char*)&ps, sizeof(ps)) < 0){
+        release(&pidhash[i].lock);
+        return -1;
+      }
+      n++;
+    }
+    release(&pidhash[i].lock);
   }
+  return n;
+}
+
+// Give p its default signal stack, mapped at SIGNALSTACK,
+// the first time it needs one. Returns 0, or -1 if out of
+// memory.
+static int
+sigstackmap(struct proc *p)
+{
+  char *mem;
+
+  if(p->signaling.stack)
+    return 0;
+  if((mem = kzalloc()) == 0)
+    return -1;
+  if(mappages(p->pagetable, SIGNALSTACK, PGSIZE, (uint64)mem,
+              PTE_R | PTE_W | PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  p->signaling.stack = mem;
+  return 0;
+}
+
+// Unmap and free p's default signal stack, if it has one.
+void
+sigstackfree(struct proc *p, pagetable_t pagetable)
+{
+  if(p->signaling.stack == 0)
+    return;
+  uvmunmap(pagetable, SIGNALSTACK, 1, 1);
+  p->signaling.stack = 0;
+}
+
+// Run custom handlers on the size bytes of user memory at sp
+// instead of the default signal stack, or go back to that
+// one if size is 0. Returns 0, or -1.
+int
+sigaltstack(uint64 sp, uint64 size)
+{
+  struct proc *p = myproc();
+
+  if(size == 0){
+    for(int i = 0; i < SIGNAL_CATCHABLE_COUNT; i++){
+      signal_handler_t h = p->signaling.handlers[i];
+      if(h != SIGNAL_HANDLER_IGNORE && h != SIGNAL_HANDLER_TERMINATE &&
+         sigstackmap(p) < 0)
+        return -1;
+    }
+  } else if(size < MINSIGSTACK || sp + size < sp || sp + size > MAXVA){
+    return -1;
+  }
+  p->signaling.altstack = sp;
+  p->signaling.altsize = size;
+  return 0;
 }
 
 int set_signal_handler(enum signal_type type, signal_handler_t handler) {
+  struct proc *p = myproc();
+
   if(type < 0 || type >= SIGNAL_CATCHABLE_COUNT) return 1;
-  myproc()->signaling.handlers[type] = handler;
+  if(handler != SIGNAL_HANDLER_IGNORE && handler != SIGNAL_HANDLER_TERMINATE &&
+     !p->signaling.altsize && sigstackmap(p) < 0)
+    return 1;
+  p->signaling.handlers[type] = handler;
+  p->signaling.batch &= ~(1 << type);
   return 0;
 }
 
-int send_signal(signal_t signal, int receiver_pid) {
-  struct proc* receiving_proc = 0;
-  for (int i = 0; i < NPROC; i++) {
-    if (proc[i].pid == receiver_pid) {
-      receiving_proc = &proc[i];
-    }
+// Like set_signal_handler(), but handler is called with a
+// vector of all the pending signals of that type.
+int set_signal_batch_handler(enum signal_type type, signal_batch_handler_t handler) {
+  struct proc *p = myproc();
+
+  if(type < 0 || type >= SIGNAL_CATCHABLE_COUNT) return 1;
+  if(handler == (signal_batch_handler_t)SIGNAL_HANDLER_IGNORE ||
+     handler == (signal_batch_handler_t)SIGNAL_HANDLER_TERMINATE)
+    return set_signal_handler(type, (signal_handler_t)handler);
+  if(!p->signaling.altsize && sigstackmap(p) < 0)
+    return 1;
+  p->signaling.handlers[type] = (signal_handler_t)handler;
+  p->signaling.batch |= 1 << type;
+  return 0;
+}
+
+// Post a signal to p: push it onto p's inbox, or merge it
+// into a pending one if its type is COALESCED, counting it n
+// times. Then wake p if it is in an interruptible sleep, or
+// from any sleep for a KILL.
+// Returns 1 if the queue is full or no memory is left for it.
+// Takes no lock except p->lock for the wakeup; the caller
+// must keep p from being freed (see putproc()).
+static int
+queue_signal(struct proc *p, signal_t signal, int n)
+{
+  struct sigentry *e;
+  int bit = 1 << signal.type;
+
+  if (SIGNAL_COALESCED_MASK & bit) {
+    __atomic_fetch_add(&p->signaling.nsent[signal.type], n, __ATOMIC_RELAXED);
+    __atomic_store_n(&p->signaling.sender[signal.type], signal.sender_pid, __ATOMIC_RELAXED);
+    __atomic_fetch_or(&p->signaling.pending, bit, __ATOMIC_RELEASE);
+  } else {
+    if((e = sigreserve(p)) == 0)
+      return 1;
+    sigpost(p, e, signal);
+    return 0;
   }
-  if (receiving_proc == 0) {
-    return 2;
+
+  if(signal.type == SIGNAL_KILL){
+    // Don't wait for p to come back to user space on its
+    // own: end any sleep now, as kill() does, so the killed()
+    // checks tear p down on its own kernel stack.
+    acquire(&p->lock);
+    p->killed = 1;
+    if(p->state == SLEEPING)
+      setrunnable(p);
+    release(&p->lock);
+    return 0;
   }
-  
-  if(signal.sender_pid != receiver_pid) {
-    acquire(&(receiving_proc->lock));
+
+  sigwake(p);
+  return 0;
+}
+
+// Wake p if it is in an interruptible sleep.
+static void
+sigwake(struct proc *p)
+{
+  // Pairs with the barrier in sleep1().
+  __sync_synchronize();
+  if(__atomic_load_n(&p->intr, __ATOMIC_RELAXED)){
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->intr)
+      setrunnable(p);
+    release(&p->lock);
   }
+}
 
-  if (receiving_proc->signaling.count+1 < MAX_SIGNALS) {
-    receiving_proc->signaling.queue[receiving_proc->signaling.write] = signal;
-    receiving_proc->signaling.write = (receiving_proc->signaling.write + 1) % MAX_SIGNALS;
-    receiving_proc->signaling.count++;
-  } else {
+// Reserve one of p's MAXSIGQUEUE queue slots, with its entry,
+// for a queued signal to be sent by sigpost(). Returns 0 if
+// the queue is full or no memory is left for it.
+struct sigentry*
+sigreserve(struct proc *p)
+{
+  struct sigentry *e;
+
+  if (__atomic_fetch_add(&p->signaling.count, 1, __ATOMIC_RELAXED) + 1 >= MAXSIGQUEUE) {
     // Queue full, new signal failed to be added
-    return 1;
+    __atomic_fetch_sub(&p->signaling.count, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+  if((e = slaballoc(&sigslab)) == 0){
+    __atomic_fetch_sub(&p->signaling.count, 1, __ATOMIC_RELAXED);
+    return 0;
   }
+  return e;
+}
+
+// Give back a slot from sigreserve() that won't be used.
+void
+sigunreserve(struct proc *p, struct sigentry *e)
+{
+  slabfree(&sigslab, e);
+  __atomic_fetch_sub(&p->signaling.count, 1, __ATOMIC_RELAXED);
+}
+
+// Queue a QUEUED-type signal in a slot from sigreserve(), with
+// a single CAS, and wake p as queue_signal() does. Cannot fail.
+// The caller must keep p from being freed.
+void
+sigpost(struct proc *p, struct sigentry *e, signal_t signal)
+{
+  e->signal = signal;
+  e->next = __atomic_load_n(&p->signaling.inbox, __ATOMIC_RELAXED);
+  while(!__atomic_compare_exchange_n(&p->signaling.inbox, &e->next, e, 1,
+                                     __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+    ;
+  sigwake(p);
+}
+
+// Whether type names a signal. It comes from user space and
+// indexes per-type arrays and bitmasks.
+static int
+sigvalid(int type)
+{
+  return type >= 0 && type <= SIGNAL_COUNT && type != SIGNAL_CATCHABLE_COUNT;
+}
+
+// Send a signal to the process with the given pid. Holding
+// its pid hash bucket keeps the process from being freed, so
+// the receiver's p->lock, which the scheduler takes, is left
+// alone. Returns 2 if there is no such process or no such
+// signal type.
+int send_signal(signal_t signal, int receiver_pid) {
+  struct pidhash *h;
+  struct proc *p;
+  int result = 2;
 
-  if(signal.sender_pid != receiver_pid) {
-    release(&(receiving_proc->lock));
+  if (receiver_pid <= 0 || !sigvalid(signal.type)) {
+    return 2;
   }
-  
-  return 0;
+  h = &pidhash[receiver_pid % NPIDHASH];
+  acquire(&h->lock);
+  for(p = h->head; p; p = p->pidnext)
+    if(p->pid == receiver_pid)
+      break;
+  if(p && p->state != UNUSED)
+    result = queue_signal(p, signal, 1);
+  release(&h->lock);
+  return result;
 }
 
-int alarm(struct proc *alarmed_proc, unsigned int seconds) {
-  int remaining_seconds = 0;
-  uint64 cycles_needed = seconds * 10;
-  uint64 local_ticks = ticks;
-  
-  acquire(&(alarmed_proc->lock));
-  if (alarmed_proc->alarm_set == 1) {
-    if (seconds == 0) {
-      alarmed_proc->alarm_set = 0;
-    }
-    remaining_seconds = (alarmed_proc->cycles_at_alarm - local_ticks) / 10;
-    alarmed_proc->cycles_at_alarm = local_ticks + cycles_needed;
+// Send a signal to every member of process group pgid,
+// in one pass over the group's hash bucket. Returns the
+// number of members reached, or -1 if there are none or
+// the type is not a signal.
+int
+send_signal_group(signal_t signal, int pgid)
+{
+  struct pidhash *h;
+  struct proc *p;
+  int found = 0, sent = 0;
+
+  if(pgid <= 0 || !sigvalid(signal.type))
+    return -1;
+  h = &pgrphash[pgid % NPIDHASH];
+  acquire(&h->lock);
+  for(p = h->head; p; p = p->pgnext){
+    if(p->pgid != pgid || p->state == UNUSED || p->state == ZOMBIE)
+      continue;
+    found = 1;
+    if(queue_signal(p, signal, 1) == 0)
+      sent++;
+  }
+  release(&h->lock);
+  return found ? sent : -1;
+}
+
+// Move process pid (0 for the caller), which must be the
+// caller or one of its children, into group pgid (0 for a
+// new group named after pid). Returns 0, or -1.
+int
+setpgid(int pid, int pgid)
+{
+  struct proc *p = myproc();
+  struct proc *q;
+
+  if(pid < 0 || pgid < 0)
+    return -1;
+  if(pid == 0)
+    pid = p->pid;
+  if(pgid == 0)
+    pgid = pid;
+
+  acquire(&wait_lock);
+  if(pid == p->pid){
+    q = p;
   } else {
-    alarmed_proc->alarm_set = 1;
-    alarmed_proc->cycles_at_alarm = seconds * 10 + local_ticks;
+    for(q = p->children; q; q = q->sibling)
+      if(q->pid == pid && q->state != ZOMBIE)
+        break;
+  }
+  if(q == 0){
+    release(&wait_lock);
+    return -1;
+  }
+  // Holding wait_lock keeps q from being reaped meanwhile.
+  pgrp_remove(q);
+  q->pgid = pgid;
+  pgrp_insert(q);
+  release(&wait_lock);
+  return 0;
+}
+
+// Return the group of process pid (0 for the caller), or -1.
+int
+getpgid(int pid)
+{
+  struct proc *p;
+  int pgid;
+
+  if(pid == 0)
+    return myproc()->pgid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  pgid = p->pgid;
+  release(&p->lock);
+  return pgid;
+}
+
+// p's alarm timer went off. A periodic timer is re-armed
+// from its last deadline, so it doesn't drift; periods that
+// went by unseen are counted into the signal.
+static void
+alarmtimer(struct hrtimer *t)
+{
+  struct proc *p = t->arg;
+  uint64 interval = p->alarm_interval;
+  int n = 1;
+
+  if(interval){
+    n += (r_time() - t->expires) / interval;
+    hrtimer_add(t, t->expires + n * interval);
   }
-  release(&(alarmed_proc->lock));
-  return remaining_seconds;
+  // putproc() stops the timer before freeing p.
+  if(p->state != UNUSED && p->state != ZOMBIE)
+    queue_signal(p, (signal_t){.type=SIGNAL_ALARM, .sender_pid=p->pid}, n);
+}
+
+// Raise SIGNAL_ALARM in p once value timer cycles from now,
+// then every interval cycles if that is nonzero, replacing
+// any earlier alarm. A zero value just cancels it. Returns
+// the cycles left on the earlier alarm.
+uint64
+setitimer(struct proc *p, uint64 value, uint64 interval)
+{
+  uint64 now = r_time();
+  uint64 left = 0;
+
+  if(hrtimer_del(&p->alarm_timer) && p->alarm_timer.expires > now)
+    left = p->alarm_timer.expires - now;
+  if(interval && interval < ITIMERMIN)
+    interval = ITIMERMIN;
+  p->alarm_interval = interval;
+  if(value > 0)
+    hrtimer_add(&p->alarm_timer, now + value);
+  return left;
+}
+
+// Raise SIGNAL_ALARM in p after the given number of seconds
+// (ten ticks each), replacing any earlier alarm. Zero just
+// cancels it. Returns the seconds left on the earlier alarm.
+int alarm(struct proc *p, unsigned int seconds) {
+  uint64 second = 10 * TICKINTERVAL;
+
+  return setitimer(p, seconds * second, 0) / second;
 }
@@ -23,15 +23,52 @@ struct context {
   uint64 s11;
 };
 
+#ifdef SCHED_MLFQ
+#define NRUNQ NPRIO
+#else
+#define NRUNQ 1
+#endif
+
+// RUNNABLE processes waiting for one CPU, one FIFO per
+// priority level. Round-robin only uses level 0.
+struct runq {
+  struct spinlock lock;
+  struct proc *head[NRUNQ];   // Next process to run at each level.
+  struct proc *tail[NRUNQ];   // Most recently queued at each level.
+  int len;                    // Number of queued processes.
+};
+
+// Processes sleeping on channels that hash to one bucket.
+struct waitq {
+  struct spinlock lock;
+  struct proc *head;
+};
+
+// Live processes whose pids hash to one bucket.
+struct pidhash {
+  struct spinlock lock;
+  struct proc *head;
+};
+
 // Per-CPU state.
 struct cpu {
   struct proc *proc;          // The process running on this cpu, or null.
   struct context context;     // swtch() here to enter scheduler().
   int noff;                   // Depth of push_off() nesting.
   int intena;                 // Were interrupts enabled before push_off()?
+  struct runq rq;             // Processes waiting to run on this cpu.
+  int nsteal;                 // Processes taken from other cpus' queues.
+  int nmigrate;               // Processes run here after running elsewhere.
+  uint boosted;               // ticks at the last MLFQ priority reset.
+  uint64 idle;                // r_time() spent in wfi.
+  uint64 nswtch;              // Switches into a process.
+  int ticking;                // Is a timer interrupt armed?
+  volatile int inwfi;         // Idle; needs an IPI to see new work.
+  uint kgen;                  // kstacks.gen at this hart's last flush.
 };
 
 extern struct cpu cpus[NCPU];
+extern volatile uint64 cpuonline;
 
 // per-process data for the trap handling code in trampoline.S.
 // sits in a page by itself just under the trampoline page in the
@@ -87,33 +124,81 @@ struct trapframe {
 enum procstate { UNUSED, USED, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
+// The fields the scheduler touches on every switch come
+// first, so that they share the first few cache lines.
 struct proc {
   struct spinlock lock;
 
   // p->lock must be held when using these:
   enum procstate state;        // Process state
-  void *chan;                  // If non-zero, sleeping on chan
+  int cpu;                     // Run queue this process goes back on
+  int prio;                    // Run queue level, 0 is the highest
+  int nice;                    // Highest level prio may be boosted to
+  struct context context;      // swtch() here to run process
+  uint64 tstamp;               // r_time() when last queued or run
+  uint64 runtime;              // r_time() spent RUNNING
+  uint64 waittime;             // r_time() spent RUNNABLE
+  uint64 nswtch;               // Times switched to
+  uint64 nvcsw;                // Times switched out by sched()
+  uint64 nivcsw;               // Times switched out by preempt()
+
+  // the run queue's lock must be held when using this:
+  struct proc *rqnext;         // Next process on the same run queue
+
+  // p->lock must be held when using these:
   int killed;                  // If non-zero, have been killed
   int xstate;                  // Exit status to be returned to parent's wait
   int pid;                     // Process ID
-  struct signaling signaling;
+  int intr;                    // If non-zero, a signal ends the sleep
 
-  // this is stuff for the alarm signal
-  uint8 alarm_set;
-  uint64 cycles_at_alarm;
+  // senders update these atomically; the rest is private
+  // to the process (see signal.h):
+  struct signaling signaling;
 
-  // wait_lock must be held when using this:
+  // wait_lock must be held when using these:
   struct proc *parent;         // Parent process
+  struct proc *children;       // Most recently forked child
+  struct proc *sibling;        // Next child of the same parent
+
+  // the pid hash bucket's lock must be held when using this:
+  struct proc *pidnext;        // Next process in the same pid bucket
+
+  // wait_lock must be held to change this, and the group
+  // hash bucket's lock to use the links:
+  int pgid;                    // Process group, 0 for none
+  struct proc *pgnext;         // Neighbours in the same group bucket
+  struct proc *pgprev;
+
+  // the wait queue's lock must be held when using these:
+  void *chan;                  // If non-zero, sleeping on chan
+  struct waitq *wq;            // Wait queue holding this process, or null
+  struct proc *wqnext;         // Neighbours on the wait queue
+  struct proc *wqprev;
+
+  // the timer wheel's lock protects this:
+  struct timer sleep_timer;    // Ends sys_sleep()
+
+  // the hrtimer list's lock protects this:
+  struct hrtimer alarm_timer;  // Raises SIGNAL_ALARM
+
+  // setitimer() sets this, with alarm_timer stopped:
+  uint64 alarm_interval;       // Period of alarm_timer, or 0
 
   // these are private to the process, so p->lock need not be held.
   uint64 kstack;               // Virtual address of kernel stack
   uint64 sz;                   // Size of process memory (bytes)
   pagetable_t pagetable;       // User page table
   struct trapframe *trapframe; // data page for trampoline.S
-  struct context context;      // swtch() here to run process
   struct file *ofile[NOFILE];  // Open files
+  struct mchan *mchan[NPMCHAN]; // Channel mapped at MCHAN(i)
+  void (*kfn)(void*);          // Body of a kernel thread (see kthread())
+  void *karg;
+
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+
+  // the aio lock must be held when using this:
+  int naio;                    // aiosubmit() requests in flight
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,24 @@
+// Scheduler statistics, as returned by schedstat().
+// Times are in mtime units, STAT_HZ per second.
+
+#define STAT_HZ 10000000  // mtime frequency on qemu's virt machine
+
+struct cpustat {
+  uint64 idle;       // Time spent waiting for work in wfi
+  uint64 nswtch;     // Switches into a process
+  int queued;        // Processes on this cpu's run queue
+  int nsteal;        // Processes taken from other cpus' queues
+  int nmigrate;      // Processes run here after running elsewhere
+};
+
+struct procstat {
+  int pid;
+  int state;         // enum procstate
+  int prio;
+  int cpu;           // Cpu it last ran on or is queued on
+  uint64 runtime;    // Time spent RUNNING
+  uint64 waittime;   // Time spent RUNNABLE, waiting for a cpu
+  uint64 nvcsw;      // Voluntary switches: sleep, yield, exit
+  uint64 nivcsw;     // Involuntary switches: timer preemption
+  char name[16];
+};
@@ -10,23 +10,36 @@ typedef struct signal {
 #define SIGNAL_HANDLER(name) int name(signal_t signal)
 typedef int (*signal_handler_t)(signal_t);
 
+// A batch handler is passed every pending signal of its type
+// at once, oldest first, and returns like a plain handler.
+#define SIGNAL_BATCH_HANDLER(name) int name(signal_t *signals, int n)
+typedef int (*signal_batch_handler_t)(signal_t*, int);
+
 #define SIGNAL_HANDLER_IGNORE    ((signal_handler_t)(-1))
 #define SIGNAL_HANDLER_TERMINATE ((signal_handler_t)(-2))
 
 //
 // X-Macro for defining signals
 //
+// QUEUED signals are queued one entry per send. Pending
+// COALESCED signals of a type merge into one, delivered with
+// the number of sends in its payload; they carry no data.
+//
 #define SIGNALS \
-  CATCHABLE_SIGNAL(ALARM, IGNORE) /* Timed interrupt */ \
-  CATCHABLE_SIGNAL(MESSAGE, IGNORE) /* Send arbitrary data to another process */ \
-  UNCATCHABLE_SIGNAL(KILL) /* Unconditionally kill a process */ \
+  CATCHABLE_SIGNAL(ALARM, IGNORE, COALESCED) /* Timed interrupt */ \
+  CATCHABLE_SIGNAL(MESSAGE, IGNORE, QUEUED) /* Send arbitrary data to another process */ \
+  CATCHABLE_SIGNAL(AIO, IGNORE, QUEUED) /* aioread()/aiowrite() finished: id << 32 | result */ \
+  UNCATCHABLE_SIGNAL(KILL, COALESCED) /* Unconditionally kill a process */ \
+
+#define SIGNAL_MODE_QUEUED    0
+#define SIGNAL_MODE_COALESCED 1
 
 enum signal_type {
   //
   // List catchable signals
   //
-  #define CATCHABLE_SIGNAL(name, handler) SIGNAL_##name,
-  #define UNCATCHABLE_SIGNAL(name)
+  #define CATCHABLE_SIGNAL(name, handler, mode) SIGNAL_##name,
+  #define UNCATCHABLE_SIGNAL(name, mode)
   SIGNALS
   #undef CATCHABLE_SIGNAL
   #undef UNCATCHABLE_SIGNAL
@@ -37,8 +50,8 @@ enum signal_type {
   //
   // List uncatchable signals
   // 
-  #define CATCHABLE_SIGNAL(name, handler)
-  #define UNCATCHABLE_SIGNAL(name) SIGNAL_##name,
+  #define CATCHABLE_SIGNAL(name, handler, mode)
+  #define UNCATCHABLE_SIGNAL(name, mode) SIGNAL_##name,
   SIGNALS
   #undef CATCHABLE_SIGNAL
   #undef UNCATCHABLE_SIGNAL
@@ -48,14 +61,41 @@ enum signal_type {
   SIGNAL_COUNT = SIGNAL_overshot_count - 1
 };
 
-#define MAX_SIGNALS 512
+// Bit set for each COALESCED type
+enum {
+  SIGNAL_COALESCED_MASK =
+  #define CATCHABLE_SIGNAL(name, handler, mode) (SIGNAL_MODE_##mode << SIGNAL_##name) |
+  #define UNCATCHABLE_SIGNAL(name, mode) (SIGNAL_MODE_##mode << SIGNAL_##name) |
+  SIGNALS
+  #undef CATCHABLE_SIGNAL
+  #undef UNCATCHABLE_SIGNAL
+  0
+};
+
+// A queued signal. Entries come from a pool shared by all
+// processes, so a process only holds the ones it has pending.
+struct sigentry {
+  signal_t signal;
+  struct sigentry *next;
+};
+
+// Senders never take the receiver's lock. They push onto
+// inbox, and set bits in pending, with atomic instructions;
+// everything else is only touched by the receiver itself.
 typedef struct signaling {
-  signal_t queue[MAX_SIGNALS];
+  struct sigentry *inbox;      // Newest first; pushed by senders
+  struct sigentry *head;       // Oldest signal taken from the inbox
+  struct sigentry *tail;       // Newest signal taken from the inbox
   signal_handler_t handlers[SIGNAL_CATCHABLE_COUNT];
-  void *stack;
-  int read;
-  int write;
-  int count;
+  void *stack;                 // Mapped at SIGNALSTACK once needed, or null
+  uint64 altstack;             // Handler stack set by sigaltstack()
+  uint64 altsize;              // Its size, or 0 to use stack
+  uint64 frame;                // Where the running handler's frame is saved
+  int batch;                   // Bit set for each type with a batch handler
+  int count;                   // Queued signals, at most MAXSIGQUEUE
+  int pending;                 // Bit set for each pending COALESCED type
+  int nsent[SIGNAL_overshot_count];  // Sends not yet delivered
+  int sender[SIGNAL_overshot_count]; // Latest sender of a pending one
   int in_handler;
 } signaling_t;
 
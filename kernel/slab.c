@@ -0,0 +1,124 @@
+// Object allocator for kernel structures smaller than a page.
+//
+// Each slab page begins with a struct slabpage header and is
+// carved into as many objects as fit behind it. Pages are taken
+// from kalloc() when every page is full and handed back to
+// kfree() as soon as their last object is freed, so a burst of
+// allocations doesn't pin memory afterwards.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "slab.h"
+#include "defs.h"
+
+struct slabobj {
+  struct slabobj *next;
+};
+
+struct slabpage {
+  struct slabpage *next;       // Neighbours on the partial list
+  struct slabpage *prev;
+  struct slabobj *free;        // Free objects in this page
+  int nfree;
+};
+
+#define SLABHDR ((sizeof(struct slabpage) + 15) & ~15)
+
+void
+slabinit(struct slab *s, char *name, uint size)
+{
+  initlock(&s->lock, name);
+  s->name = name;
+  s->size = (size + 15) & ~15;
+  if(s->size < sizeof(struct slabobj) || s->size > PGSIZE - SLABHDR)
+    panic("slabinit");
+  s->perpage = (PGSIZE - SLABHDR) / s->size;
+  s->partial = 0;
+  s->npages = 0;
+}
+
+static void
+partial_insert(struct slab *s, struct slabpage *pg)
+{
+  pg->prev = 0;
+  pg->next = s->partial;
+  if(s->partial)
+    s->partial->prev = pg;
+  s->partial = pg;
+}
+
+static void
+partial_remove(struct slab *s, struct slabpage *pg)
+{
+  if(pg->prev)
+    pg->prev->next = pg->next;
+  else
+    s->partial = pg->next;
+  if(pg->next)
+    pg->next->prev = pg->prev;
+  pg->next = pg->prev = 0;
+}
+
+// Allocate one object of s->size bytes. Its contents are
+// undefined. Returns 0 if no memory is left.
+void*
+slaballoc(struct slab *s)
+{
+  struct slabpage *pg;
+  struct slabobj *o;
+  char *mem;
+
+  acquire(&s->lock);
+  if(s->partial == 0){
+    release(&s->lock);
+    if((mem = kalloc()) == 0)
+      return 0;
+    pg = (struct slabpage*)mem;
+    pg->free = 0;
+    for(int i = s->perpage - 1; i >= 0; i--){
+      o = (struct slabobj*)(mem + SLABHDR + i * s->size);
+      o->next = pg->free;
+      pg->free = o;
+    }
+    pg->nfree = s->perpage;
+    acquire(&s->lock);
+    partial_insert(s, pg);
+    s->npages++;
+  }
+
+  pg = s->partial;
+  o = pg->free;
+  pg->free = o->next;
+  if(--pg->nfree == 0)
+    partial_remove(s, pg);
+  release(&s->lock);
+  return (void*)o;
+}
+
+// Free an object returned by slaballoc(s).
+void
+slabfree(struct slab *s, void *obj)
+{
+  struct slabpage *pg = (struct slabpage*)PGROUNDDOWN((uint64)obj);
+  struct slabobj *o = obj;
+
+  if(((char*)obj - (char*)pg - SLABHDR) % s->size != 0)
+    panic("slabfree");
+
+  acquire(&s->lock);
+  o->next = pg->free;
+  pg->free = o;
+  if(pg->nfree++ == 0)
+    partial_insert(s, pg);
+  if(pg->nfree == s->perpage){
+    partial_remove(s, pg);
+    s->npages--;
+    release(&s->lock);
+    kfree(pg);
+    return;
+  }
+  release(&s->lock);
+}
@@ -0,0 +1,13 @@
+// Allocator for kernel objects smaller than a page.
+// Needs spinlock.h.
+
+struct slabpage;
+
+struct slab {
+  struct spinlock lock;
+  char *name;                  // For debugging
+  uint size;                   // Object size, rounded up
+  uint perpage;                // Objects that fit in one page
+  struct slabpage *partial;    // Pages with at least one free object
+  int npages;                  // Pages currently held
+};
@@ -10,10 +10,12 @@ void timerinit();
 // entry.S needs one stack per CPU.
 __attribute__ ((aligned (16))) char stack0[4096 * NCPU];
 
-// a scratch area per CPU for machine-mode timer interrupts.
-uint64 timer_scratch[NCPU][5];
+// a scratch area per CPU for machine-mode timer and
+// software interrupts; see timerinit().
+uint64 timer_scratch[NCPU][6];
 
-// assembly code in kernelvec.S for machine-mode timer interrupt.
+// assembly code in kernelvec.S for machine-mode timer
+// and software interrupts.
 extern void timervec();
 
 // entry.S jumps here in machine mode on stack0.
@@ -54,7 +56,7 @@ start()
   asm volatile("mret");
 }
 
-// arrange to receive timer interrupts.
+// arrange to receive timer interrupts and IPIs.
 // they will arrive in machine mode at
 // at timervec in kernelvec.S,
 // which turns them into software interrupts for
@@ -65,25 +67,32 @@ timerinit()
   // each CPU has a separate source of timer interrupts.
   int id = r_mhartid();
 
-  // ask the CLINT for a timer interrupt.
-  int interval = 1000000; // cycles; about 1/10th second in qemu.
-  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + interval;
+  // ask the CLINT for a timer interrupt. timervec disarms
+  // it, and devintr() asks for the next one with clockarm().
+  *(uint64*)CLINT_MTIMECMP(id) = *(uint64*)CLINT_MTIME + TICKINTERVAL;
 
   // prepare information in scratch[] for timervec.
   // scratch[0..2] : space for timervec to save registers.
   // scratch[3] : address of CLINT MTIMECMP register.
-  // scratch[4] : desired interval (in cycles) between timer interrupts.
+  // scratch[4] : address of CLINT MSIP register.
+  // scratch[5] : set by timervec when the timer went off.
   uint64 *scratch = &timer_scratch[id][0];
   scratch[3] = CLINT_MTIMECMP(id);
-  scratch[4] = interval;
+  scratch[4] = CLINT_MSIP(id);
+  scratch[5] = 0;
   w_mscratch((uint64)scratch);
 
+  // let supervisor mode read the time CSR, for r_time(),
+  // and user mode too, for rdtime in sigbench.
+  w_mcounteren(r_mcounteren() | 2);
+  w_scounteren(2);
+
   // set the machine-mode trap handler.
   w_mtvec((uint64)timervec);
 
   // enable machine-mode interrupts.
   w_mstatus(r_mstatus() | MSTATUS_MIE);
 
-  // enable machine-mode timer interrupts.
-  w_mie(r_mie() | MIE_MTIE);
+  // enable machine-mode timer and software interrupts.
+  w_mie(r_mie() | MIE_MTIE | MIE_MSIE);
 }
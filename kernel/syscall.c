@@ -3,6 +3,7 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "timer.h"
 #include "proc.h"
 #include "syscall.h"
 #include "defs.h"
@@ -105,6 +106,18 @@ extern uint64 sys_yield(void);
 extern uint64 sys_send_signal(void);
 extern uint64 sys_set_signal_handler(void);
 extern uint64 sys_alarm(void);
+extern uint64 sys_setpriority(void);
+extern uint64 sys_schedstat(void);
+extern uint64 sys_sigreturn(void);
+extern uint64 sys_set_signal_batch_handler(void);
+extern uint64 sys_mchan(void);
+extern uint64 sys_setitimer(void);
+extern uint64 sys_aioread(void);
+extern uint64 sys_aiowrite(void);
+extern uint64 sys_setpgid(void);
+extern uint64 sys_getpgid(void);
+extern uint64 sys_send_signal_group(void);
+extern uint64 sys_sigaltstack(void);
 
 // An array mapping syscall numbers from syscall.h
 // to the function that handles the system call.
@@ -133,7 +146,19 @@ static uint64 (*syscalls[])(void) = {
 [SYS_yield]              sys_yield,
 [SYS_send_signal]        sys_send_signal,
 [SYS_set_signal_handler] sys_set_signal_handler,
-[SYS_alarm]              sys_alarm
+[SYS_alarm]              sys_alarm,
+[SYS_setpriority]        sys_setpriority,
+[SYS_schedstat]          sys_schedstat,
+[SYS_sigreturn]          sys_sigreturn,
+[SYS_set_signal_batch_handler] sys_set_signal_batch_handler,
+[SYS_mchan]              sys_mchan,
+[SYS_setitimer]          sys_setitimer,
+[SYS_aioread]            sys_aioread,
+[SYS_aiowrite]           sys_aiowrite,
+[SYS_setpgid]            sys_setpgid,
+[SYS_getpgid]            sys_getpgid,
+[SYS_send_signal_group]  sys_send_signal_group,
+[SYS_sigaltstack]        sys_sigaltstack,
 };
 
 void
@@ -146,10 +171,7 @@ syscall(void)
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
     // Use num to lookup the system call function for num, call it,
     // and store its return value in p->trapframe->a0
-    int result = syscalls[num]();
-    
-    // We don't want to overwrite a0 when we hijack yield for signaling
-    if(!p->signaling.in_handler) p->trapframe->a0 = result;
+    p->trapframe->a0 = syscalls[num]();
   } else {
     printf("%d %s: unknown sys call %d\n",
             p->pid, p->name, num);
@@ -23,4 +23,16 @@
 #define SYS_yield  22
 #define SYS_send_signal 23
 #define SYS_set_signal_handler 24
-#define SYS_alarm 25
\ No newline at end of file
+#define SYS_alarm 25
+#define SYS_setpriority 26
+#define SYS_schedstat 27
+#define SYS_sigreturn 28
+#define SYS_set_signal_batch_handler 29
+#define SYS_mchan  30
+#define SYS_setitimer 31
+#define SYS_aioread 32
+#define SYS_aiowrite 33
+#define SYS_setpgid 34
+#define SYS_getpgid 35
+#define SYS_send_signal_group 36
+#define SYS_sigaltstack 37
\ No newline at end of file
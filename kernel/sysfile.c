@@ -10,6 +10,7 @@
 #include "param.h"
 #include "stat.h"
 #include "spinlock.h"
+#include "timer.h"
 #include "proc.h"
 #include "fs.h"
 #include "sleeplock.h"
@@ -79,6 +80,22 @@ sys_read(void)
   return fileread(f, p, n);
 }
 
+// Start a read that finishes with a SIGNAL_AIO.
+uint64
+sys_aioread(void)
+{
+  struct file *f;
+  int n, id;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &id);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return aiosubmit(f, p, n, id, 0);
+}
+
 uint64
 sys_write(void)
 {
@@ -94,6 +111,22 @@ sys_write(void)
   return filewrite(f, p, n);
 }
 
+// Start a write that finishes with a SIGNAL_AIO.
+uint64
+sys_aiowrite(void)
+{
+  struct file *f;
+  int n, id;
+  uint64 p;
+
+  argaddr(1, &p);
+  argint(2, &n);
+  argint(3, &id);
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return aiosubmit(f, p, n, id, 1);
+}
+
 uint64
 sys_close(void)
 {
@@ -4,6 +4,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "spinlock.h"
+#include "timer.h"
 #include "proc.h"
 
 uint64
@@ -48,22 +49,49 @@ sys_sbrk(void)
   return addr;
 }
 
+// The sleeper checks its timer under tickslock,
+// so take it too to avoid a lost wakeup.
+static void
+sleeptimer(struct timer *t)
+{
+  acquire(&tickslock);
+  wakeup(t);
+  release(&tickslock);
+}
+
 uint64
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
+  uint left;
+  struct proc *p = myproc();
+  struct timer *t = &p->sleep_timer;
 
   argint(0, &n);
-  
+  if(n <= 0)
+    return 0;
+
+  t->fn = sleeptimer;
   acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(killed(myproc())){
+  timer_add(t, ticks + n);
+  while(timer_pending(t)){
+    if(killed(p)){
       release(&tickslock);
+      timer_del(t);
       return -1;
     }
-    if(sleep(&ticks, &tickslock)) break;
+    if(sleepintr(t, &tickslock)){
+      // A signal is waiting. Let usertrapret() deliver it,
+      // and have the ecall re-run for the ticks that are
+      // left once the handler returns.
+      left = t->expires - ticks;
+      release(&tickslock);
+      if(timer_del(t) && (int)left > 0){
+        p->trapframe->epc -= 4;
+        return left;
+      }
+      return 0;
+    }
   }
   release(&tickslock);
   return 0;
@@ -91,6 +119,12 @@ sys_uptime(void)
   return xticks;
 }
 
+uint64
+sys_sigreturn(void)
+{
+  return sigreturn();
+}
+
 uint64
 sys_yield(void)
 {
@@ -113,6 +147,49 @@ sys_send_signal(void)
   );
 }
 
+uint64
+sys_send_signal_group(void)
+{
+  struct proc *p = myproc();
+  return send_signal_group(
+    (signal_t){
+      .type = p->trapframe->a0,
+      .sender_pid = p->pid,
+      .payload = p->trapframe->a2,
+    },
+    p->trapframe->a1
+  );
+}
+
+uint64
+sys_sigaltstack(void)
+{
+  uint64 sp, size;
+
+  argaddr(0, &sp);
+  argaddr(1, &size);
+  return sigaltstack(sp, size);
+}
+
+uint64
+sys_setpgid(void)
+{
+  int pid, pgid;
+
+  argint(0, &pid);
+  argint(1, &pgid);
+  return setpgid(pid, pgid);
+}
+
+uint64
+sys_getpgid(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return getpgid(pid);
+}
+
 uint64
 sys_set_signal_handler(void)
 {
@@ -120,7 +197,56 @@ sys_set_signal_handler(void)
   return set_signal_handler(p->trapframe->a0, (signal_handler_t)p->trapframe->a1);
 }
 
+uint64
+sys_set_signal_batch_handler(void)
+{
+  struct proc *p = myproc();
+  return set_signal_batch_handler(p->trapframe->a0, (signal_batch_handler_t)p->trapframe->a1);
+}
+
+uint64
+sys_mchan(void)
+{
+  int pid;
+
+  argint(0, &pid);
+  return mchanopen(pid);
+}
+
 uint64 sys_alarm(void) {
   struct proc *p = myproc();
   return alarm(p, p->trapframe->a0);
-}
\ No newline at end of file
+}
+
+uint64
+sys_setitimer(void)
+{
+  uint64 value, interval;
+
+  argaddr(0, &value);
+  argaddr(1, &interval);
+  return setitimer(myproc(), value, interval);
+}
+
+uint64
+sys_setpriority(void)
+{
+  int pid, prio;
+
+  argint(0, &pid);
+  argint(1, &prio);
+  return setpriority(pid, prio);
+}
+
+uint64
+sys_schedstat(void)
+{
+  uint64 cs, ps;
+  int ncpu, nproc;
+
+  argaddr(0, &cs);
+  argint(1, &ncpu);
+  argaddr(2, &ps);
+  argint(3, &nproc);
+  return schedstat(cs, ncpu, ps, nproc);
+}
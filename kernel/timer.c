@@ -0,0 +1,290 @@
+// Hierarchical timer wheel.
+//
+// Pending timers are filed in TW_LEVELS wheels of TW_SLOTS slots.
+// Each level-0 slot holds the timers due on one tick; a slot of
+// level n covers TW_SLOTS^n ticks. A timer goes in the lowest
+// level whose range reaches its deadline. Whenever a level wraps
+// around, the next slot of the level above is refiled into the
+// levels below, so each tick only has to look at a single
+// level-0 slot, whatever the number of timers.
+//
+// High-resolution timers don't wait for a tick: they are kept
+// on a list sorted by mtime deadline, and hart 0's CLINT
+// compare register is set to the earlier of its next tick and
+// the first deadline, so they fire in between ticks.
+
+#include "types.h"
+#include "param.h"
+#include "memlayout.h"
+#include "spinlock.h"
+#include "riscv.h"
+#include "timer.h"
+#include "defs.h"
+
+#define TW_BITS   6
+#define TW_SLOTS  (1 << TW_BITS)
+#define TW_MASK   (TW_SLOTS - 1)
+#define TW_LEVELS 4
+#define TW_MAX    ((1U << (TW_BITS * TW_LEVELS)) - 1)  // furthest deadline filed exactly
+
+struct {
+  struct spinlock lock;
+  uint now;                    // Last tick processed
+  struct timer *running;       // Timer whose callback is running
+  struct timer *wheel[TW_LEVELS][TW_SLOTS];
+} tw;
+
+struct {
+  struct spinlock lock;
+  uint64 tick;                 // r_time() of hart 0's next tick
+  struct hrtimer *running;     // Timer whose callback is running
+  struct hrtimer *head;        // Earliest deadline first
+} hr;
+
+void
+timerwheelinit(void)
+{
+  initlock(&tw.lock, "timer");
+  tw.now = ticks;
+  initlock(&hr.lock, "hrtimer");
+}
+
+static void
+timer_link(struct timer **slot, struct timer *t)
+{
+  t->slot = slot;
+  t->prev = 0;
+  t->next = *slot;
+  if(*slot)
+    (*slot)->prev = t;
+  *slot = t;
+}
+
+static void
+timer_unlink(struct timer *t)
+{
+  if(t->prev)
+    t->prev->next = t->next;
+  else
+    *t->slot = t->next;
+  if(t->next)
+    t->next->prev = t->prev;
+  t->next = t->prev = 0;
+  t->slot = 0;
+}
+
+// File t in the wheel according to t->expires.
+// Caller must hold tw.lock.
+static void
+timer_file(struct timer *t)
+{
+  uint delta = t->expires - tw.now;
+  uint when = t->expires;
+  int level;
+
+  if((int)delta <= 0){
+    // Already due: run it on the next tick.
+    when = tw.now + 1;
+    delta = 1;
+  } else if(delta > TW_MAX){
+    // Too far out: park it at the top and refile it later.
+    when = tw.now + TW_MAX;
+    delta = TW_MAX;
+  }
+  for(level = 0; level < TW_LEVELS - 1; level++)
+    if(delta < (1U << (TW_BITS * (level + 1))))
+      break;
+  timer_link(&tw.wheel[level][(when >> (TW_BITS * level)) & TW_MASK], t);
+}
+
+// Arm t to call t->fn once ticks reaches expires,
+// re-arming it if it is already pending.
+void
+timer_add(struct timer *t, uint expires)
+{
+  acquire(&tw.lock);
+  if(t->slot)
+    timer_unlink(t);
+  t->expires = expires;
+  timer_file(t);
+  release(&tw.lock);
+}
+
+// Cancel t. Returns 1 if it was still pending. Once this
+// returns, t->fn is neither running nor going to run, so
+// the caller must not hold any lock that t->fn takes.
+int
+timer_del(struct timer *t)
+{
+  int pending;
+
+  acquire(&tw.lock);
+  while(tw.running == t){
+    release(&tw.lock);
+    acquire(&tw.lock);
+  }
+  pending = t->slot != 0;
+  if(pending)
+    timer_unlink(t);
+  release(&tw.lock);
+  return pending;
+}
+
+int
+timer_pending(struct timer *t)
+{
+  int pending;
+
+  acquire(&tw.lock);
+  pending = t->slot != 0;
+  release(&tw.lock);
+  return pending;
+}
+
+// Refile the timers of the slot in each higher level
+// that the wheel has just moved onto.
+static void
+timer_cascade(void)
+{
+  struct timer *t;
+  int level;
+  uint idx;
+
+  for(level = 1; level < TW_LEVELS; level++){
+    if((tw.now >> (TW_BITS * (level - 1))) & TW_MASK)
+      break;
+    idx = (tw.now >> (TW_BITS * level)) & TW_MASK;
+    while((t = tw.wheel[level][idx]) != 0){
+      timer_unlink(t);
+      // This tick's level-0 slot hasn't been run yet.
+      if(t->expires == tw.now)
+        timer_link(&tw.wheel[0][tw.now & TW_MASK], t);
+      else
+        timer_file(t);
+    }
+  }
+}
+
+// Advance the wheel to now, running every timer that
+// falls due. Called from clockintr() on hart 0.
+void
+timer_tick(uint now)
+{
+  struct timer *t;
+
+  acquire(&tw.lock);
+  while(tw.now != now){
+    tw.now++;
+    timer_cascade();
+    while((t = tw.wheel[0][tw.now & TW_MASK]) != 0){
+      timer_unlink(t);
+      tw.running = t;
+      release(&tw.lock);
+      t->fn(t);
+      acquire(&tw.lock);
+      tw.running = 0;
+    }
+  }
+  release(&tw.lock);
+}
+
+// Point hart 0's timer at whatever is due first.
+// Caller must hold hr.lock.
+static void
+hrtimer_program(void)
+{
+  uint64 when = hr.tick;
+
+  if(hr.head && hr.head->expires < when)
+    when = hr.head->expires;
+  *(uint64*)CLINT_MTIMECMP(0) = when;
+}
+
+// Schedule hart 0's next tick; called by clockarm().
+void
+hrtimer_arm(uint64 tick)
+{
+  acquire(&hr.lock);
+  hr.tick = tick;
+  hrtimer_program();
+  release(&hr.lock);
+}
+
+static void
+hrtimer_unlink(struct hrtimer *t)
+{
+  struct hrtimer **pp;
+
+  for(pp = &hr.head; *pp != t; pp = &(*pp)->next)
+    ;
+  *pp = t->next;
+  t->next = 0;
+  t->pending = 0;
+}
+
+// Arm t to call t->fn once r_time() reaches expires,
+// re-arming it if it is already pending. May be called
+// from t->fn itself.
+void
+hrtimer_add(struct hrtimer *t, uint64 expires)
+{
+  struct hrtimer **pp;
+
+  acquire(&hr.lock);
+  if(t->pending)
+    hrtimer_unlink(t);
+  t->expires = expires;
+  for(pp = &hr.head; *pp && (*pp)->expires <= expires; pp = &(*pp)->next)
+    ;
+  t->next = *pp;
+  *pp = t;
+  t->pending = 1;
+  if(hr.head == t)
+    hrtimer_program();
+  release(&hr.lock);
+}
+
+// Cancel t, as timer_del() does. Returns 1 if it was
+// still pending.
+int
+hrtimer_del(struct hrtimer *t)
+{
+  int pending;
+
+  acquire(&hr.lock);
+  while(hr.running == t){
+    release(&hr.lock);
+    acquire(&hr.lock);
+  }
+  pending = t->pending;
+  if(pending)
+    hrtimer_unlink(t);
+  release(&hr.lock);
+  return pending;
+}
+
+// Run every high-resolution timer that is due. Returns 1 if
+// hart 0's tick is due as well; otherwise re-arms hart 0's
+// timer for the next deadline. Called on hart 0 for each of
+// its timer interrupts.
+int
+hrtimer_intr(void)
+{
+  struct hrtimer *t;
+  int tick;
+
+  acquire(&hr.lock);
+  while((t = hr.head) != 0 && t->expires <= r_time()){
+    hrtimer_unlink(t);
+    hr.running = t;
+    release(&hr.lock);
+    t->fn(t);
+    acquire(&hr.lock);
+    hr.running = 0;
+  }
+  tick = r_time() >= hr.tick;
+  if(!tick)
+    hrtimer_program();
+  release(&hr.lock);
+  return tick;
+}
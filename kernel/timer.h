@@ -0,0 +1,24 @@
+// One-shot kernel timer, run from the clock interrupt
+// on hart 0 once ticks reaches expires. See timer.c.
+struct timer {
+  uint expires;                // ticks value to fire at
+  void (*fn)(struct timer*);   // Called without the wheel lock
+  void *arg;                   // For use by fn
+
+  // the timer wheel's lock must be held when using these:
+  struct timer **slot;         // Wheel slot holding this timer, or null
+  struct timer *next;          // Neighbours in the same slot
+  struct timer *prev;
+};
+
+// One-shot high-resolution timer, run on hart 0 once the
+// CLINT's mtime reaches expires. See timer.c.
+struct hrtimer {
+  uint64 expires;              // r_time() value to fire at
+  void (*fn)(struct hrtimer*); // Called without the list lock
+  void *arg;                   // For use by fn
+
+  // the hrtimer list's lock must be held when using these:
+  int pending;                 // On the list
+  struct hrtimer *next;        // Next to expire
+};
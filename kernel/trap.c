@@ -3,12 +3,15 @@
 #include "memlayout.h"
 #include "riscv.h"
 #include "spinlock.h"
+#include "timer.h"
 #include "proc.h"
 #include "defs.h"
 
 struct spinlock tickslock;
 uint ticks;
 
+extern uint64 timer_scratch[NCPU][6]; // start.c
+
 extern char trampoline[], uservec[], userret[];
 
 // in kernelvec.S, calls kerneltrap().
@@ -65,6 +68,8 @@ usertrap(void)
     intr_on();
 
     syscall();
+  } else if(r_scause() == 15 && uvmcow(p->pagetable, r_stval()) == 0){
+    // store to a copy-on-write page, which now has its own copy
   } else if((which_dev = devintr()) != 0){
     // ok
   } else {
@@ -78,7 +83,7 @@ usertrap(void)
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2)
-    yield();
+    preempt();
 
   usertrapret();
 }
@@ -91,6 +96,9 @@ usertrapret(void)
 {
   struct proc *p = myproc();
 
+  // this may divert the return into a signal handler, or exit.
+  deliver_signals();
+
   // we're about to switch the destination of traps from
   // kerneltrap() to usertrap(), so turn off interrupts until
   // we're back in user space, where usertrap() is correct.
@@ -151,7 +159,7 @@ kerneltrap()
 
   // give up the CPU if this is a timer interrupt.
   if(which_dev == 2 && myproc() != 0 && myproc()->state == RUNNING)
-    yield();
+    preempt();
 
   // the yield() may have caused some traps to occur,
   // so restore trap registers for use by kernelvec.S's sepc instruction.
@@ -162,10 +170,38 @@ kerneltrap()
 void
 clockintr()
 {
+  uint now;
+
   acquire(&tickslock);
-  ticks++;
-  wakeup(&ticks);
+  now = ++ticks;
   release(&tickslock);
+
+  // Sleepers and alarms are woken by their own timers,
+  // only once they are due.
+  timer_tick(now);
+}
+
+// Ask for this hart's next timer interrupt, one tick
+// from now. Interrupts must be disabled.
+void
+clockarm(void)
+{
+  uint64 next = r_time() + TICKINTERVAL;
+
+  // Hart 0 shares its timer with the high-resolution timers.
+  if(cpuid() == 0)
+    hrtimer_arm(next);
+  else
+    *(uint64*)CLINT_MTIMECMP(cpuid()) = next;
+  mycpu()->ticking = 1;
+}
+
+// Interrupt hart c, which is idle in wfi, so that
+// it looks at the run queues again.
+void
+ipi(struct cpu *c)
+{
+  *(uint32*)CLINT_MSIP(c - cpus) = 1;
 }
 
 // check if it's an external interrupt or software interrupt,
@@ -201,18 +237,33 @@ devintr()
 
     return 1;
   } else if(scause == 0x8000000000000001L){
-    // software interrupt from a machine-mode timer interrupt,
-    // forwarded by timervec in kernelvec.S.
+    // software interrupt from a machine-mode timer interrupt
+    // or IPI, forwarded by timervec in kernelvec.S.
+    int id = cpuid();
+    int tick = 0;
 
-    if(cpuid() == 0){
-      clockintr();
-    }
-    
     // acknowledge the software interrupt by clearing
     // the SSIP bit in sip.
     w_sip(r_sip() & ~2);
 
-    return 2;
+    // Hart 0's timer also goes off for high-resolution
+    // timers in between its ticks.
+    if(timer_scratch[id][5]){
+      timer_scratch[id][5] = 0;
+      if(id != 0 || hrtimer_intr()){
+        mycpu()->ticking = 0;
+        tick = 1;
+        if(id == 0)
+          clockintr();
+        // Hart 0 keeps time. Other harts stop ticking
+        // while idle, until the scheduler finds them work.
+        if(id == 0 || mycpu()->proc)
+          clockarm();
+      }
+    }
+
+    // An IPI only wakes the hart from wfi.
+    return tick ? 2 : 1;
   } else {
     return 0;
   }
@@ -21,8 +21,7 @@ kvmmake(void)
 {
   pagetable_t kpgtbl;
 
-  kpgtbl = (pagetable_t) kalloc();
-  memset(kpgtbl, 0, PGSIZE);
+  kpgtbl = (pagetable_t) kzalloc();
 
   // uart registers
   kvmmap(kpgtbl, UART0, UART0, PGSIZE, PTE_R | PTE_W);
@@ -30,6 +29,9 @@ kvmmake(void)
   // virtio mmio disk interface
   kvmmap(kpgtbl, VIRTIO0, VIRTIO0, PGSIZE, PTE_R | PTE_W);
 
+  // CLINT, to send IPIs and arm each hart's timer
+  kvmmap(kpgtbl, CLINT, CLINT, 0x10000, PTE_R | PTE_W);
+
   // PLIC
   kvmmap(kpgtbl, PLIC, PLIC, 0x400000, PTE_R | PTE_W);
 
@@ -43,12 +45,31 @@ kvmmake(void)
   // the highest virtual address in the kernel.
   kvmmap(kpgtbl, TRAMPOLINE, (uint64)trampoline, PGSIZE, PTE_R | PTE_X);
 
-  // allocate and map a kernel stack for each process.
-  proc_mapstacks(kpgtbl);
-  
   return kpgtbl;
 }
 
+// Map the page pa at va in the kernel page table after boot,
+// for a kernel stack. Callers must serialize. Returns 0, or
+// -1 if out of memory for page-table pages.
+int
+kvmmapstack(uint64 va, uint64 pa)
+{
+  if(mappages(kernel_pagetable, va, PGSIZE, pa, PTE_R | PTE_W) != 0)
+    return -1;
+  sfence_vma();
+  return 0;
+}
+
+// Unmap and free the kernel stack page at va. Callers must
+// serialize. Other harts may still hold the old translation
+// in their TLBs; see kstackalloc().
+void
+kvmunmapstack(uint64 va)
+{
+  uvmunmap(kernel_pagetable, va, 1, 1);
+  sfence_vma();
+}
+
 // Initialize the one kernel_pagetable
 void
 kvminit(void)
@@ -93,9 +114,8 @@ walk(pagetable_t pagetable, uint64 va, int alloc)
     if(*pte & PTE_V) {
       pagetable = (pagetable_t)PTE2PA(*pte);
     } else {
-      if(!alloc || (pagetable = (pde_t*)kalloc()) == 0)
+      if(!alloc || (pagetable = (pde_t*)kzalloc()) == 0)
         return 0;
-      memset(pagetable, 0, PGSIZE);
       *pte = PA2PTE(pagetable) | PTE_V;
     }
   }
@@ -197,10 +217,9 @@ pagetable_t
 uvmcreate()
 {
   pagetable_t pagetable;
-  pagetable = (pagetable_t) kalloc();
+  pagetable = (pagetable_t) kzalloc();
   if(pagetable == 0)
     return 0;
-  memset(pagetable, 0, PGSIZE);
   return pagetable;
 }
 
@@ -214,8 +233,7 @@ uvmfirst(pagetable_t pagetable, uchar *src, uint sz)
 
   if(sz >= PGSIZE)
     panic("uvmfirst: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kzalloc();
   mappages(pagetable, 0, PGSIZE, (uint64)mem, PTE_W|PTE_R|PTE_X|PTE_U);
   memmove(mem, src, sz);
 }
@@ -233,12 +251,11 @@ uvmalloc(pagetable_t pagetable, uint64 oldsz, uint64 newsz, int xperm)
 
   oldsz = PGROUNDUP(oldsz);
   for(a = oldsz; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kzalloc();
     if(mem == 0){
       uvmdealloc(pagetable, a, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     if(mappages(pagetable, a, PGSIZE, (uint64)mem, PTE_R|PTE_U|xperm) != 0){
       kfree(mem);
       uvmdealloc(pagetable, a, oldsz);
@@ -298,32 +315,46 @@ uvmfree(pagetable_t pagetable, uint64 sz)
 
 // Given a parent process's page table, copy
 // its memory into a child's page table.
-// Copies both the page table and the
-// physical memory.
+// Copies the page table, but shares the
+// physical memory: writable pages become
+// read-only and copy-on-write in both, and
+// uvmcow() copies them on the first store.
+// A writable page that uvmpin() holds for an
+// AIO read may still be stored to, so the
+// child gets a copy of it at once instead.
 // returns 0 on success, -1 on failure.
 // frees any allocated pages on failure.
 int
 uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
 {
-  pte_t *pte;
+  pte_t *pte, e;
   uint64 pa, i;
-  uint flags;
   char *mem;
 
   for(i = 0; i < sz; i += PGSIZE){
     if((pte = walk(old, i, 0)) == 0)
       panic("uvmcopy: pte should exist");
-    if((*pte & PTE_V) == 0)
+    e = *pte;
+    if((e & PTE_V) == 0)
       panic("uvmcopy: page not present");
-    pa = PTE2PA(*pte);
-    flags = PTE_FLAGS(*pte);
-    if((mem = kalloc()) == 0)
-      goto err;
-    memmove(mem, (char*)pa, PGSIZE);
-    if(mappages(new, i, PGSIZE, (uint64)mem, flags) != 0){
-      kfree(mem);
-      goto err;
+    pa = PTE2PA(e);
+    if((e & PTE_W) && krefs((void*)pa) > 1){
+      if((mem = kalloc()) == 0)
+        goto err;
+      memmove(mem, (char*)pa, PGSIZE);
+      if(mappages(new, i, PGSIZE, (uint64)mem, PTE_FLAGS(e)) != 0){
+        kfree(mem);
+        goto err;
+      }
+      continue;
+    }
+    if(e & PTE_W){
+      e = (e & ~PTE_W) | PTE_COW;
+      *pte = e;
     }
+    if(mappages(new, i, PGSIZE, pa, PTE_FLAGS(e)) != 0)
+      goto err;
+    kdup((void*)pa);
   }
   return 0;
 
@@ -332,6 +363,87 @@ uvmcopy(pagetable_t old, pagetable_t new, uint64 sz)
   return -1;
 }
 
+// Give pagetable its own writable copy of the copy-on-write
+// page at va. If nothing else shares the page any more, just
+// make it writable again. Returns 0 on success, or -1 if va
+// is not a copy-on-write user page or memory ran out.
+int
+uvmcow(pagetable_t pagetable, uint64 va)
+{
+  pte_t *pte;
+  uint64 pa;
+  uint flags;
+  char *mem;
+
+  if(va >= MAXVA)
+    return -1;
+  va = PGROUNDDOWN(va);
+  if((pte = walk(pagetable, va, 0)) == 0)
+    return -1;
+  if((*pte & (PTE_V|PTE_U|PTE_COW)) != (PTE_V|PTE_U|PTE_COW))
+    return -1;
+  pa = PTE2PA(*pte);
+  flags = (PTE_FLAGS(*pte) | PTE_W) & ~PTE_COW;
+
+  if(krefs((void*)pa) == 1){
+    *pte = PA2PTE(pa) | flags;
+    return 0;
+  }
+
+  if((mem = kalloc()) == 0)
+    return -1;
+  memmove(mem, (char*)pa, PGSIZE);
+  *pte = PA2PTE(mem) | flags;
+  kfree((void*)pa);
+  return 0;
+}
+
+// Map the user pages under [va, va+len) of old into new at
+// the same addresses, with a reference on each, so that they
+// stay allocated whatever old's owner does to its mappings.
+// If write, the pages are to be stored to: copy-on-write
+// pages are copied first, so the stores land in old's own
+// pages. Returns 0, or -1 with nothing mapped if part of the
+// range is not a (writable) user page.
+int
+uvmpin(pagetable_t old, pagetable_t new, uint64 va, uint64 len, int write)
+{
+  pte_t *pte;
+  uint64 a, pa;
+
+  if(len == 0)
+    return 0;
+  if(va + len < va || va + len > MAXVA)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va + len; a += PGSIZE){
+    if((pte = walk(old, a, 0)) == 0 || (*pte & (PTE_V|PTE_U)) != (PTE_V|PTE_U))
+      goto err;
+    if(write && (*pte & PTE_COW) && uvmcow(old, a) < 0)
+      goto err;
+    if(write && (*pte & PTE_W) == 0)
+      goto err;
+    pa = PTE2PA(*pte);
+    if(mappages(new, a, PGSIZE, pa, PTE_FLAGS(*pte) & ~PTE_COW) != 0)
+      goto err;
+    kdup((void*)pa);
+  }
+  return 0;
+
+ err:
+  uvmunmap(new, PGROUNDDOWN(va), (a - PGROUNDDOWN(va)) / PGSIZE, 1);
+  return -1;
+}
+
+// Undo uvmpin(): unmap [va, va+len) from pagetable and drop
+// the references.
+void
+uvmunpin(pagetable_t pagetable, uint64 va, uint64 len)
+{
+  if(len > 0)
+    uvmunmap(pagetable, PGROUNDDOWN(va),
+             (PGROUNDUP(va + len) - PGROUNDDOWN(va)) / PGSIZE, 1);
+}
+
 // mark a PTE invalid for user access.
 // used by exec for the user stack guard page.
 void
@@ -352,9 +464,18 @@ int
 copyout(pagetable_t pagetable, uint64 dstva, char *src, uint64 len)
 {
   uint64 n, va0, pa0;
+  pte_t *pte;
 
   while(len > 0){
     va0 = PGROUNDDOWN(dstva);
+    if(va0 >= MAXVA)
+      return -1;
+    pte = walk(pagetable, va0, 0);
+    if(pte && (*pte & PTE_COW) && uvmcow(pagetable, va0) < 0)
+      return -1;
+    // a shared read-only page must not change under the others
+    if(pte == 0 || (*pte & PTE_W) == 0)
+      return -1;
     pa0 = walkaddr(pagetable, va0);
     if(pa0 == 0)
       return -1;
@@ -0,0 +1,49 @@
+// Parallel page allocation benchmark.
+//
+// 1, 2, 4 and 8 worker processes each grow their heap by
+// CHUNK pages and shrink it again, ROUNDS times, so every
+// page goes through kalloc() and kfree(). Run it under
+// "make qemu CPUS=n" for n = 1, 2, 4, 8: with per-hart page
+// caches, pages per 100 ticks should grow with the number of
+// workers until workers > CPUS.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "kernel/riscv.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define CHUNK   64    // pages allocated and freed per round
+#define ROUNDS  200   // rounds per worker
+
+// Grow and shrink the heap ROUNDS times.
+int
+churn(int w)
+{
+  for(int r = 0; r < ROUNDS; r++){
+    char *p = sbrk(CHUNK * PGSIZE);
+    if(p == (char*)-1){
+      printf("allocbench: sbrk failed\n");
+      return 1;
+    }
+    // Touch each page, as a real user would.
+    for(int i = 0; i < CHUNK; i++)
+      p[i * PGSIZE] = r;
+    sbrk(-CHUNK * PGSIZE);
+  }
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int workers[] = { 1, 2, 4, 8 };
+
+  printf("allocbench: %d rounds of %d pages per worker\n", ROUNDS, CHUNK);
+  for(int i = 0; i < sizeof(workers)/sizeof(workers[0]); i++){
+    int n = workers[i];
+    benchreport("alloc", n, benchrun("allocbench", n, churn),
+                n * ROUNDS * CHUNK, "pages");
+  }
+  exit(0);
+}
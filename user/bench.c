@@ -0,0 +1,65 @@
+// Shared harness for the fork-N-workers benchmarks.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+volatile uint64 benchsink;
+
+// Burn the CPU for units work units.
+void
+benchspin(int units)
+{
+  uint64 x = 0;
+
+  for(int u = 0; u < units; u++)
+    for(int i = 0; i < UNITLEN; i++)
+      x = x * 6364136223846793005UL + i;
+  benchsink = x;
+}
+
+// Fork nworkers children; child w runs fn(w) and exits
+// with its return value. Exits if fork fails.
+void
+benchfork(char *name, int nworkers, int (*fn)(int))
+{
+  for(int w = 0; w < nworkers; w++){
+    int pid = fork();
+    if(pid < 0){
+      printf("%s: fork failed\n", name);
+      exit(1);
+    }
+    if(pid == 0)
+      exit(fn(w));
+  }
+}
+
+// Run nworkers workers at once, wait for all of them and
+// return the elapsed time in ticks, at least 1.
+int
+benchrun(char *name, int nworkers, int (*fn)(int))
+{
+  int start = uptime();
+  int t;
+
+  benchfork(name, nworkers, fn);
+  for(int w = 0; w < nworkers; w++){
+    if(wait(0) < 0){
+      printf("%s: wait failed\n", name);
+      exit(1);
+    }
+  }
+
+  t = uptime() - start;
+  return t > 0 ? t : 1;
+}
+
+// Print one line of a results table: done units of work
+// in ticks, as a rate per 100 ticks.
+void
+benchreport(char *what, int nworkers, int ticks, int done, char *unit)
+{
+  printf("%s workers %d: %d ticks, %d %s/100ticks\n",
+         what, nworkers, ticks, done * 100 / ticks, unit);
+}
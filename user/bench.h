@@ -0,0 +1,9 @@
+// Shared harness for the fork-N-workers benchmarks
+// (scalebench, stealbench, allocbench).
+
+#define UNITLEN 2000000 // loop iterations per work unit
+
+void benchspin(int units);
+void benchfork(char *name, int nworkers, int (*fn)(int));
+int benchrun(char *name, int nworkers, int (*fn)(int));
+void benchreport(char *what, int nworkers, int ticks, int done, char *unit);
@@ -0,0 +1,67 @@
+// Fork/compute scaling benchmark.
+//
+// Runs a fixed amount of CPU-bound work split across 1, 2, 4 and 8
+// worker processes, then a fork/exit storm, and reports throughput
+// for each.  Run it under "make qemu CPUS=n" for n = 1, 2, 4, 8 and
+// compare the lines: compute throughput should grow with the number
+// of harts until workers > CPUS.
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define UNITS     64      // total work units per run
+#define NFORK     200     // children created by the fork run
+
+int nworkers;
+
+int
+compute(int w)
+{
+  benchspin(UNITS / nworkers);
+  return 0;
+}
+
+int
+none(int w)
+{
+  return 0;
+}
+
+// Create NFORK children that exit at once, nworkers at a time,
+// and return the elapsed time in ticks.
+int
+forkstorm(void)
+{
+  int start = uptime();
+  int t;
+
+  for(int n = 0; n < NFORK; n += nworkers){
+    benchfork("scalebench", nworkers, none);
+    for(int w = 0; w < nworkers; w++)
+      wait(0);
+  }
+
+  t = uptime() - start;
+  return t > 0 ? t : 1;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int workers[] = { 1, 2, 4, 8 };
+
+  printf("scalebench: %d units x %d iterations, %d forks\n",
+         UNITS, UNITLEN, NFORK);
+  for(int i = 0; i < sizeof(workers)/sizeof(workers[0]); i++){
+    nworkers = workers[i];
+    benchreport("compute", nworkers,
+                benchrun("scalebench", nworkers, compute), UNITS, "units");
+  }
+  for(int i = 0; i < sizeof(workers)/sizeof(workers[0]); i++){
+    nworkers = workers[i];
+    benchreport("fork   ", nworkers, forkstorm(), NFORK, "forks");
+  }
+  exit(0);
+}
@@ -0,0 +1,226 @@
+// Signal delivery benchmark.
+//
+// Measures, in microseconds of mtime:
+//   self    send_signal() to the caller, to its handler running
+//   cross   send_signal() to a child asleep, normally on another
+//           hart (fork places it on the idlest one), to
+//           its handler running
+//   alarm   deviation of a periodic setitimer() ALARM from its
+//           period
+// and also sustained MESSAGE throughput into a batch handler,
+// and how many sends fill a blocked process's queue and what a
+// failing send costs. Each line starts with "sigbench:" and the
+// test name, followed by name=value fields, so runs can be
+// compared with a text diff or awk.
+//
+// usage: sigbench [samples]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/signal.h"
+#include "user/user.h"
+
+#define HZ       10000000 // mtime cycles per second in qemu
+#define US(t)    ((int)((t) / (HZ / 1000000)))
+#define MAXN     1000
+#define NTHRU    20000    // messages sent by the throughput test
+#define PERIOD   (TICKINTERVAL / 10)
+
+uint64 lat[MAXN];
+int nlat;
+volatile uint64 last;
+volatile int received;
+int ackfd;
+
+static inline uint64
+rdtime(void)
+{
+  uint64 x;
+  asm volatile("rdtime %0" : "=r" (x));
+  return x;
+}
+
+void
+sort(uint64 *a, int n)
+{
+  for(int gap = n / 2; gap > 0; gap /= 2)
+    for(int i = gap; i < n; i++)
+      for(int j = i; j >= gap && a[j-gap] > a[j]; j -= gap){
+        uint64 t = a[j];
+        a[j] = a[j-gap];
+        a[j-gap] = t;
+      }
+}
+
+void
+report(char *name, uint64 *a, int n)
+{
+  if(n == 0){
+    printf("sigbench: %s n=0\n", name);
+    return;
+  }
+  sort(a, n);
+  printf("sigbench: %s n=%d p50=%d p90=%d p99=%d max=%d us\n", name, n,
+         US(a[n/2]), US(a[n*9/10]), US(a[n*99/100]), US(a[n-1]));
+}
+
+SIGNAL_HANDLER(self_handler) {
+  if(nlat < MAXN)
+    lat[nlat++] = rdtime() - signal.payload;
+  return 0;
+}
+
+void
+self(int n)
+{
+  set_signal_handler(SIGNAL_MESSAGE, self_handler);
+  nlat = 0;
+  for(int i = 0; i < n; i++)
+    send_signal(SIGNAL_MESSAGE, getpid(), rdtime());
+  set_signal_handler(SIGNAL_MESSAGE, SIGNAL_HANDLER_IGNORE);
+  report("self", lat, nlat);
+}
+
+// Child side of cross: send back how long each message took.
+SIGNAL_HANDLER(cross_handler) {
+  uint64 t = rdtime() - signal.payload;
+  write(ackfd, &t, sizeof(t));
+  return 0;
+}
+
+void
+cross(int n)
+{
+  int ack[2], pid;
+  uint64 ready;
+
+  pipe(ack);
+  if((pid = fork()) == 0){
+    ackfd = ack[1];
+    set_signal_handler(SIGNAL_MESSAGE, cross_handler);
+    ready = 0;
+    write(ackfd, &ready, sizeof(ready));
+    for(;;)
+      sleep(1000);
+  }
+  read(ack[0], &ready, sizeof(ready));
+  for(nlat = 0; nlat < n; nlat++){
+    if(send_signal(SIGNAL_MESSAGE, pid, rdtime()) != 0 ||
+       read(ack[0], &lat[nlat], sizeof(lat[0])) != sizeof(lat[0]))
+      break;
+  }
+  send_signal(SIGNAL_KILL, pid, 0);
+  wait(0);
+  close(ack[0]);
+  close(ack[1]);
+  report("cross", lat, nlat);
+}
+
+SIGNAL_BATCH_HANDLER(thru_handler) {
+  received += n;
+  if(received >= NTHRU)
+    write(ackfd, "x", 1);
+  return 0;
+}
+
+void
+throughput(void)
+{
+  int ack[2], pid, retries = 0;
+  uint64 start, t;
+  char c;
+
+  pipe(ack);
+  if((pid = fork()) == 0){
+    ackfd = ack[1];
+    set_signal_batch_handler(SIGNAL_MESSAGE, thru_handler);
+    write(ackfd, "x", 1);
+    for(;;)
+      sleep(1000);
+  }
+  read(ack[0], &c, 1);
+  start = rdtime();
+  for(int i = 0; i < NTHRU; i++)
+    while(send_signal(SIGNAL_MESSAGE, pid, i) != 0)
+      retries++;
+  read(ack[0], &c, 1);
+  t = rdtime() - start;
+  send_signal(SIGNAL_KILL, pid, 0);
+  wait(0);
+  close(ack[0]);
+  close(ack[1]);
+  printf("sigbench: throughput n=%d us=%d per_sec=%d full_retries=%d\n",
+         NTHRU, US(t), (int)(NTHRU * (uint64)HZ / (t ? t : 1)), retries);
+}
+
+void
+queuefull(void)
+{
+  int blk[2], pid, count = 0;
+  uint64 t;
+  char c;
+
+  pipe(blk);
+  if((pid = fork()) == 0){
+    read(blk[0], &c, 1);
+    exit(0);
+  }
+  while(send_signal(SIGNAL_MESSAGE, pid, count) == 0)
+    count++;
+  t = rdtime();
+  for(int i = 0; i < 100; i++)
+    send_signal(SIGNAL_MESSAGE, pid, 0);
+  t = rdtime() - t;
+  write(blk[1], "x", 1);
+  wait(0);
+  close(blk[0]);
+  close(blk[1]);
+  printf("sigbench: queuefull accepted=%d failed_send_ns=%d\n",
+         count, (int)(t * (1000000000 / HZ) / 100));
+}
+
+SIGNAL_HANDLER(alarm_handler) {
+  uint64 now = rdtime();
+  uint64 want = (uint64)PERIOD * signal.payload;
+
+  if(last && nlat < MAXN)
+    lat[nlat++] = now - last > want ? now - last - want : want - (now - last);
+  last = now;
+  received++;
+  return 0;
+}
+
+void
+jitter(int n)
+{
+  nlat = 0;
+  last = 0;
+  received = 0;
+  set_signal_handler(SIGNAL_ALARM, alarm_handler);
+  setitimer(PERIOD, PERIOD);
+  while(received <= n)
+    sleep(1);
+  setitimer(0, 0);
+  set_signal_handler(SIGNAL_ALARM, SIGNAL_HANDLER_IGNORE);
+  report("alarm", lat, nlat);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 200;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0 || n > MAXN){
+    printf("usage: sigbench [samples <= %d]\n", MAXN);
+    exit(1);
+  }
+
+  self(n);
+  cross(n);
+  throughput();
+  queuefull();
+  jitter(n / 10 > 10 ? n / 10 : 10);
+  exit(0);
+}
@@ -2,6 +2,8 @@
 #include "kernel/signal.h"
 #include "user/user.h"
 
+#define SECOND 10000000 // timer cycles per second in qemu
+
 int pid;
 
 void killself(void) {
@@ -29,8 +31,7 @@ SIGNAL_HANDLER(print_message) {
 }
 
 SIGNAL_HANDLER(repeated_alarm) {
-  printf("Beep beep beep!\n");
-  alarm(2);
+  printf("Beep beep beep! (x%d)\n", (int)signal.payload);
   return 0;
 }
 
@@ -46,14 +47,14 @@ int main(int argc, char **argv) {
   send_signal(SIGNAL_MESSAGE, getpid(), 509);
   sleep(2);
   
-  alarm(2);
+  setitimer(SECOND / 5, SECOND / 5);
   printf("wake up...\n");
   set_signal_handler(SIGNAL_ALARM, repeated_alarm);
   sleep(4);
   printf("snoozing...\n");
   set_signal_handler(SIGNAL_ALARM, SIGNAL_HANDLER_IGNORE);
   sleep(4);
-  alarm(2);
+  setitimer(SECOND / 5, SECOND / 5);
   printf("wake up...\n");
   set_signal_handler(SIGNAL_ALARM, repeated_alarm);
   sleep(4);
@@ -0,0 +1,60 @@
+// Load-balancing benchmark.
+//
+// One parent forks N CPU-bound children back to back and waits for
+// them. With balanced run queues every hart stays busy, so the
+// children finish close together; a hart left saturated shows up as
+// a wide spread between the first and last child to finish.
+// The per-hart steal and migration counters are printed by ^P.
+//
+// usage: stealbench [nchildren]
+
+#include "kernel/types.h"
+#include "kernel/stat.h"
+#include "user/user.h"
+#include "user/bench.h"
+
+#define UNITS    8       // work units per child
+
+int start;
+
+// report when this child finished, relative to start.
+int
+child(int w)
+{
+  benchspin(UNITS);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int n = 8;
+  int first, last, status;
+
+  if(argc > 1)
+    n = atoi(argv[1]);
+  if(n <= 0){
+    printf("usage: stealbench [nchildren]\n");
+    exit(1);
+  }
+
+  start = uptime();
+  benchfork("stealbench", n, child);
+
+  first = -1;
+  last = 0;
+  for(int i = 0; i < n; i++){
+    if(wait(&status) < 0){
+      printf("stealbench: wait failed\n");
+      exit(1);
+    }
+    if(first < 0 || status < first)
+      first = status;
+    if(status > last)
+      last = status;
+  }
+
+  printf("stealbench: %d children, %d ticks total, first done at %d, last at %d, spread %d\n",
+         n, uptime() - start, first, last, last - first);
+  exit(0);
+}
@@ -8,6 +8,7 @@
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
 #include "kernel/signal.h"
+#include "kernel/mchan.h"
 
 // Basis for this file was taken from the usertests.c file.
 
@@ -69,13 +70,34 @@ SIGNAL_HANDLER(simple_alarm) {
     exit(0);
 }
 
+// alarm(1) is ten ticks away, so sleep well past it.
 void simplealarm() {
     set_signal_handler(SIGNAL_ALARM, simple_alarm);
     alarm(1);
-    sleep(4);
+    sleep(20);
     exit(1);
 }
 
+int alarmat;
+
+SIGNAL_HANDLER(time_alarm) {
+    alarmat = uptime();
+    return 0;
+}
+
+// alarm(1) must not fire before its second (ten ticks) is up.
+void earlyalarm() {
+    int start;
+
+    set_signal_handler(SIGNAL_ALARM, time_alarm);
+    start = uptime();
+    alarm(1);
+    while(alarmat == 0 && uptime() - start < 40)
+        sleep(1);
+    printf(" (alarm after %d ticks)  ", alarmat - start);
+    exit(alarmat - start >= 9 ? 0 : 1);
+}
+
 SIGNAL_HANDLER(while_alarm) {
     printf("(while alarm) Alarm has been received.\n");
     exit(0);
@@ -98,21 +120,290 @@ void printaddress() {
     printf("%p\n\n",&whilealarm);
 }
 
+// Fill a blocked child's queue with messages until a send fails.
 void fullqueue() {
-    int count = 1;
-    while(!send_signal(SIGNAL_ALARM, getpid(), 0)) {
-        count++;
+    int fds[2];
+    int count = 0;
+    char c;
+
+    pipe(fds);
+    if(!(pid = fork())) {
+        read(fds[0], &c, 1);
+        exit(0);
     }
+    while(!send_signal(SIGNAL_MESSAGE, pid, count))
+        count++;
     printf(" (Full queue count = %d)  ", count);
+    write(fds[1], "x", 1);
+    wait(&pid);
+    exit(pid);
+}
+
+int alarmcount;
+
+SIGNAL_HANDLER(count_alarm) {
+    alarmcount = signal.payload;
+    return 0;
+}
+
+// Alarms sent while the child is blocked merge into one,
+// whose payload counts them.
+void coalesce() {
+    int fds[2], back[2];
+    char c;
+
+    pipe(fds);
+    pipe(back);
+    if(!(pid = fork())) {
+        set_signal_handler(SIGNAL_ALARM, count_alarm);
+        write(back[1], "x", 1);
+        read(fds[0], &c, 1);
+        printf(" (%d alarms merged)  ", alarmcount);
+        exit(alarmcount == 50 ? 0 : 1);
+    }
+    read(back[0], &c, 1);
+    for(int i = 0; i < 50; i++)
+        if(send_signal(SIGNAL_ALARM, pid, 0))
+            exit(1);
+    write(fds[1], "x", 1);
+    wait(&pid);
+    exit(pid);
+}
+
+int batchtotal, batchcalls;
+
+SIGNAL_BATCH_HANDLER(batch_message) {
+    for(int i = 0; i < n; i++)
+        if(signals[i].payload != batchtotal++)
+            exit(2);
+    batchcalls++;
+    return 0;
+}
+
+// Messages sent while the child is blocked must all arrive,
+// in order, and in fewer handler calls than messages.
+void batchsignal() {
+    int fds[2], back[2];
+    char c;
+
+    pipe(fds);
+    pipe(back);
+    if(!(pid = fork())) {
+        set_signal_batch_handler(SIGNAL_MESSAGE, batch_message);
+        write(back[1], "x", 1);
+        read(fds[0], &c, 1);
+        while(batchtotal < 100)
+            sleep(1);
+        printf(" (%d signals in %d calls)  ", batchtotal, batchcalls);
+        exit(batchcalls < batchtotal ? 0 : 1);
+    }
+    read(back[0], &c, 1);
+    for(int i = 0; i < 100; i++)
+        if(send_signal(SIGNAL_MESSAGE, pid, i))
+            exit(1);
+    write(fds[1], "x", 1);
+    wait(&pid);
+    exit(pid);
+}
+
+uint64 mchanbell;
+int mchanrings;
+
+SIGNAL_HANDLER(mchan_doorbell) {
+    if(signal.payload > mchanbell)
+        mchanbell = signal.payload;
+    mchanrings++;
+    return 0;
+}
+
+// Messages written in place into a shared channel arrive
+// intact and in order, each announced by its doorbell.
+void mchantest() {
+    struct mchan_ring *r;
+    int parent = getpid();
+    int fds[2];
+    char c, *m;
+
+    pipe(fds);
+    if(!(pid = fork())) {
+        set_signal_handler(SIGNAL_MESSAGE, mchan_doorbell);
+        if((r = mchan(parent)) == 0)
+            exit(1);
+        write(fds[1], "x", 1);
+        for(int i = 0; i < 100; i++) {
+            // The ring is only looked at once its doorbell rang.
+            while(mchanbell < i + 1)
+                sleep(1);
+            if((m = mchan_peek(r)) == 0)
+                exit(3);
+            for(int j = 0; j < MCHAN_SLOTSIZE; j++)
+                if(m[j] != (char)(i + j))
+                    exit(2);
+            mchan_done(r);
+        }
+        exit(mchanrings == 100 ? 0 : 4);
+    }
+    read(fds[0], &c, 1);
+    if((r = mchan(pid)) == 0)
+        exit(1);
+    for(int i = 0; i < 100; i++) {
+        while((m = mchan_reserve(r)) == 0)
+            sleep(1);
+        for(int j = 0; j < MCHAN_SLOTSIZE; j++)
+            m[j] = i + j;
+        mchan_post(r, pid);
+    }
+    wait(&pid);
+    exit(pid);
+}
+
+int itimercount;
+
+SIGNAL_HANDLER(itimer_alarm) {
+    itimercount += signal.payload;
+    return 0;
+}
+
+// A timer with a quarter-tick period fires about four
+// times per tick, counting any it merged.
+void itimer() {
+    set_signal_handler(SIGNAL_ALARM, itimer_alarm);
+    setitimer(TICKINTERVAL / 4, TICKINTERVAL / 4);
+    sleep(10);
+    setitimer(0, 0);
+    printf(" (%d alarms in 10 ticks)  ", itimercount);
+    exit(itimercount >= 30 && itimercount <= 50 ? 0 : 1);
+}
+
+int aiodone[3];
+
+SIGNAL_HANDLER(aio_done) {
+    int id = signal.payload >> 32;
+    if(id == 1 || id == 2)
+        aiodone[id] = (int)signal.payload;
+    return 0;
+}
+
+// A read left waiting on a pipe doesn't hold up the caller
+// or a later write; each reports its byte count.
+void aiotest() {
+    int a[2], b[2];
+    char rbuf[6] = {0}, tmp[5];
+
+    set_signal_handler(SIGNAL_AIO, aio_done);
+    pipe(a);
+    pipe(b);
+    if(aioread(a[0], rbuf, 5, 1) || aiowrite(b[1], "hello", 5, 2))
+        exit(1);
+    if(read(b[0], tmp, 5) != 5 || memcmp(tmp, "hello", 5))
+        exit(2);
+    write(a[1], "world", 5);
+    for(int i = 0; i < 50 && !(aiodone[1] && aiodone[2]); i++)
+        sleep(1);
+    if(aiodone[1] != 5 || aiodone[2] != 5 || strcmp(rbuf, "world"))
+        exit(3);
     exit(0);
 }
 
+int groupmsg;
+
+SIGNAL_HANDLER(group_message) {
+    groupmsg = signal.payload;
+    return 0;
+}
+
+// One send reaches every member of a new group, the
+// sender included, and nobody outside it.
+void groupsignal() {
+    int ready[2], go[2];
+    char c;
+
+    setpgid(0, 0);
+    pipe(ready);
+    pipe(go);
+    for(int i = 0; i < 5; i++) {
+        if(fork() == 0) {
+            set_signal_handler(SIGNAL_MESSAGE, group_message);
+            write(ready[1], "x", 1);
+            read(go[0], &c, 1);
+            exit(groupmsg == 42 ? 0 : 1);
+        }
+    }
+    for(int i = 0; i < 5; i++)
+        read(ready[0], &c, 1);
+    int n = send_signal_group(SIGNAL_MESSAGE, getpgid(0), 42);
+    printf(" (%d members)  ", n);
+    write(go[1], "xxxxx", 5);
+    int failed = n != 6;
+    for(int i = 0; i < 5; i++) {
+        int status;
+        wait(&status);
+        failed |= status;
+    }
+    exit(failed);
+}
+
+// KILL ends even a sleep that signals don't interrupt.
+void killblocked() {
+    int fds[2];
+    char c;
+
+    pipe(fds);
+    if(!(pid = fork())) {
+        read(fds[0], &c, 1);
+        exit(0);
+    }
+    sleep(2);
+    send_signal(SIGNAL_KILL, pid, 0);
+    wait(&pid);
+    exit(pid);
+}
+
+uint64 handlersp;
+
+SIGNAL_HANDLER(where_handler) {
+    int here;
+    handlersp = (uint64)&here;
+    return 0;
+}
+
+// Handlers run on the stack given to sigaltstack(), and on
+// the default one again once it is taken back.
+void altstack() {
+    char *stk = malloc(8192);
+
+    set_signal_handler(SIGNAL_MESSAGE, where_handler);
+    if(sigaltstack(stk, 8192))
+        exit(1);
+    send_signal(SIGNAL_MESSAGE, getpid(), 0);
+    if(handlersp < (uint64)stk || handlersp >= (uint64)stk + 8192)
+        exit(2);
+    sigaltstack(0, 0);
+    send_signal(SIGNAL_MESSAGE, getpid(), 0);
+    if(handlersp < SIGNALSTACK || handlersp >= SIGNALSTACK + PGSIZE)
+        exit(3);
+    exit(sigaltstack(stk, 16) == -1 ? 0 : 4);
+}
+
 void falsesignal() {
     int out = send_signal(SIGNAL_ALARM, -1, 0);
     printf("%d\n", out);
     exit(out);
 }
 
+// Types that are not signals are refused, not queued.
+void badsignal() {
+    int types[] = { -1, SIGNAL_CATCHABLE_COUNT, SIGNAL_COUNT + 1, 32, 1000 };
+
+    for(int i = 0; i < sizeof(types) / sizeof(types[0]); i++) {
+        if(send_signal(types[i], getpid(), 0) != 2)
+            exit(1);
+        if(send_signal_group(types[i], getpgid(0), 0) != -1)
+            exit(2);
+    }
+    exit(0);
+}
+
 struct test {
     void (*f)(char *);
     char *s;
@@ -122,11 +413,21 @@ struct test {
     {whilekill, "whilekill", -1},
     {killself, "killself", 0},
     {killchild, "killchild", -1},
+    {killblocked, "killblocked", -1},
     {fullqueue, "fullqueue", 0},
+    {coalesce, "coalesce", 0},
     {falsesignal, "falsesignal", 2},
+    {badsignal, "badsignal", 0},
     {customsignal, "customsignal"},
     {simplealarm, "simplealarm", 0},
+    {earlyalarm, "earlyalarm", 0},
     {whilealarm, "whilealarm", 0},
+    {itimer, "itimer", 0},
+    {batchsignal, "batchsignal", 0},
+    {mchantest, "mchan", 0},
+    {aiotest, "aio", 0},
+    {groupsignal, "groupsignal", 0},
+    {altstack, "altstack", 0},
     // {printaddress,"printaddress"}, // Diagnostics
     {0}, // Null terminator
 };
@@ -0,0 +1,93 @@
+// Show scheduler statistics, refreshed every interval.
+//
+// Per cpu: idle share and context switches over the interval.
+// Per process: cpu share over the interval, total run and
+// run-queue wait time in ms, and voluntary/involuntary switches.
+//
+// usage: top [count [interval-ticks]]
+
+#include "kernel/types.h"
+#include "kernel/param.h"
+#include "kernel/schedstat.h"
+#include "user/user.h"
+
+#define MAXPS 256
+#define MS(t) ((t) / (STAT_HZ / 1000))
+
+static char *states[] = { "unused", "used", "sleep", "runble", "run", "zombie" };
+
+struct cpustat cs[2][NCPU];
+struct procstat *ps[2];
+int nps[2];
+
+// Run time of pid in the previous sample, or 0.
+uint64
+prevruntime(struct procstat *prev, int n, int pid)
+{
+  for(int i = 0; i < n; i++)
+    if(prev[i].pid == pid)
+      return prev[i].runtime;
+  return 0;
+}
+
+void
+show(int cur, uint64 elapsed)
+{
+  int prev = !cur;
+  struct cpustat *c, *pc;
+  struct procstat *p;
+
+  printf("cpu  idle%%  switches  queued  steals  migrations\n");
+  for(int i = 0; i < NCPU; i++){
+    c = &cs[cur][i];
+    pc = &cs[prev][i];
+    if(c->nswtch == 0 && c->idle == 0)
+      continue;
+    printf("%d    %d      %l       %d       %d       %d\n", i,
+           (int)((c->idle - pc->idle) * 100 / elapsed),
+           c->nswtch - pc->nswtch, c->queued, c->nsteal, c->nmigrate);
+  }
+  printf("pid  state   prio cpu  cpu%%  run-ms  wait-ms  vcsw  ivcsw  name\n");
+  for(int i = 0; i < nps[cur]; i++){
+    p = &ps[cur][i];
+    printf("%d    %s  %d    %d    %d     %l     %l      %l    %l     %s\n",
+           p->pid, p->state < 6 ? states[p->state] : "???", p->prio, p->cpu,
+           (int)((p->runtime - prevruntime(ps[prev], nps[prev], p->pid)) * 100 / elapsed),
+           MS(p->runtime), MS(p->waittime), p->nvcsw, p->nivcsw, p->name);
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int count = 5, interval = 10, cur = 0;
+
+  if(argc > 1)
+    count = atoi(argv[1]);
+  if(argc > 2)
+    interval = atoi(argv[2]);
+  if(count <= 0 || interval <= 0){
+    printf("usage: top [count [interval-ticks]]\n");
+    exit(1);
+  }
+
+  ps[0] = malloc(MAXPS * sizeof(struct procstat));
+  ps[1] = malloc(MAXPS * sizeof(struct procstat));
+  if((nps[1] = schedstat(cs[1], NCPU, ps[1], MAXPS)) < 0){
+    printf("top: schedstat failed\n");
+    exit(1);
+  }
+  for(int n = 0; n < count; n++){
+    int start = uptime();
+    sleep(interval);
+    if((nps[cur] = schedstat(cs[cur], NCPU, ps[cur], MAXPS)) < 0){
+      printf("top: schedstat failed\n");
+      exit(1);
+    }
+    // Ticks are a tenth of a second.
+    show(cur, (uint64)(uptime() - start) * STAT_HZ / 10);
+    printf("\n");
+    cur = !cur;
+  }
+  exit(0);
+}
@@ -1,6 +1,7 @@
 #include "kernel/types.h"
 #include "kernel/stat.h"
 #include "kernel/fcntl.h"
+#include "kernel/mchan.h"
 #include "user/user.h"
 
 //
@@ -145,3 +146,39 @@ memcpy(void *dst, const void *src, uint n)
 {
   return memmove(dst, src, n);
 }
+
+// Return the slot to fill next in channel r, or 0 if the
+// receiver has not yet freed one.
+void*
+mchan_reserve(struct mchan_ring *r)
+{
+  if(r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == MCHAN_NSLOT)
+    return 0;
+  return r->slot[r->tail % MCHAN_NSLOT];
+}
+
+// Publish the slot from mchan_reserve() and ring the doorbell
+// of the receiver, pid. The message is in the ring already, so
+// it is not lost if pid's signal queue is full.
+void
+mchan_post(struct mchan_ring *r, int pid)
+{
+  __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+  send_signal(SIGNAL_MESSAGE, pid, r->tail);
+}
+
+// Return the oldest unread slot in channel r, or 0.
+void*
+mchan_peek(struct mchan_ring *r)
+{
+  if(r->head == __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE))
+    return 0;
+  return r->slot[r->head % MCHAN_NSLOT];
+}
+
+// Give the slot from mchan_peek() back to the sender.
+void
+mchan_done(struct mchan_ring *r)
+{
+  __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+}
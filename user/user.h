@@ -1,6 +1,9 @@
 #include "kernel/signal.h"
 
 struct stat;
+struct cpustat;
+struct procstat;
+struct mchan_ring;
 
 // system calls
 int fork(void);
@@ -26,8 +29,19 @@ int sleep(int);
 int uptime(void);
 void yield(void);
 int send_signal(enum signal_type type, int receiver_pid, uint64 payload);
+int send_signal_group(enum signal_type type, int pgid, uint64 payload);
+int setpgid(int pid, int pgid);
+int getpgid(int pid);
 int set_signal_handler(enum signal_type type, signal_handler_t handler);
+int set_signal_batch_handler(enum signal_type type, signal_batch_handler_t handler);
+int sigaltstack(void *sp, uint64 size);
 int alarm(unsigned int seconds);
+uint64 setitimer(uint64 value, uint64 interval);
+int aioread(int fd, void *buf, int n, int id);
+int aiowrite(int fd, const void *buf, int n, int id);
+int setpriority(int pid, int prio);
+int schedstat(struct cpustat*, int, struct procstat*, int);
+struct mchan_ring* mchan(int pid);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -45,3 +59,7 @@ void free(void*);
 int atoi(const char*);
 int memcmp(const void *, const void *, uint);
 void *memcpy(void *, const void *, uint);
+void* mchan_reserve(struct mchan_ring*);
+void mchan_post(struct mchan_ring*, int);
+void* mchan_peek(struct mchan_ring*);
+void mchan_done(struct mchan_ring*);
@@ -7,6 +7,7 @@
 #include "kernel/syscall.h"
 #include "kernel/memlayout.h"
 #include "kernel/riscv.h"
+#include "kernel/schedstat.h"
 
 //
 // Tests xv6 system calls.  usertests without arguments runs them all
@@ -1024,6 +1025,115 @@ forkforkfork(char *s)
   sleep(10); // one second
 }
 
+// fork a process that uses more than half of physical memory,
+// which only fits if fork shares pages copy-on-write, and check
+// that stores by the parent, the child, and the kernel (read()
+// into a shared page) each stay private.
+void
+cowfork(char *s)
+{
+  uint64 sz = (PHYSTOP - KERNBASE) / 5 * 3;
+  int fds[2], xstatus;
+  char *p, *a;
+
+  p = sbrk(sz);
+  if(p == (char*)0xffffffffffffffffL){
+    printf("%s: sbrk(%l) failed\n", s, sz);
+    exit(1);
+  }
+  for(a = p; a < p + sz; a += PGSIZE)
+    *(int*)a = getpid();
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+
+  int pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    int ppid = *(int*)p;
+    for(a = p; a < p + sz; a += 16*PGSIZE){
+      if(*(int*)a != ppid)
+        exit(1);
+      *(int*)a = getpid();
+    }
+    if(read(fds[0], p + PGSIZE + 4, 4) != 4)
+      exit(1);
+    exit(0);
+  }
+
+  *(int*)(p + 8*PGSIZE) = 0;
+  if(write(fds[1], "cow!", 4) != 4){
+    printf("%s: write failed\n", s);
+    exit(1);
+  }
+  wait(&xstatus);
+  if(xstatus != 0){
+    printf("%s: child saw the wrong memory\n", s);
+    exit(1);
+  }
+  for(a = p; a < p + sz; a += PGSIZE){
+    int want = a == p + 8*PGSIZE ? 0 : getpid();
+    if(*(int*)a != want || *(int*)(a + 4) != 0){
+      printf("%s: parent memory changed at %p\n", s, a);
+      exit(1);
+    }
+  }
+  close(fds[0]);
+  close(fds[1]);
+  sbrk(-sz);
+}
+
+// setpriority() returns the old level, refuses bad levels and
+// pids, and the level it sets is the one schedstat() reports.
+void
+setprio(char *s)
+{
+  static struct procstat ps[256];
+  int pid, i, n, fds[2];
+  char c;
+
+  if(pipe(fds) < 0){
+    printf("%s: pipe failed\n", s);
+    exit(1);
+  }
+  pid = fork();
+  if(pid < 0){
+    printf("%s: fork failed\n", s);
+    exit(1);
+  }
+  if(pid == 0){
+    read(fds[0], &c, 1);
+    exit(0);
+  }
+
+  if(setpriority(pid, NPRIO) != -1 || setpriority(pid, -1) != -1 ||
+     setpriority(-5, 0) != -1){
+    printf("%s: setpriority accepted a bad argument\n", s);
+    exit(1);
+  }
+  if(setpriority(pid, NPRIO-1) < 0 || setpriority(pid, NPRIO-1) != NPRIO-1){
+    printf("%s: setpriority did not return the old level\n", s);
+    exit(1);
+  }
+  // A process is never boosted or woken above the level it
+  // was given, and NPRIO-1 is the lowest, so it stays there.
+  n = schedstat(0, 0, ps, 256);
+  for(i = 0; i < n && ps[i].pid != pid; i++)
+    ;
+  if(i == n || ps[i].prio != NPRIO-1){
+    printf("%s: child not found at level %d\n", s, NPRIO-1);
+    exit(1);
+  }
+  write(fds[1], "x", 1);
+  wait(0);
+  close(fds[0]);
+  close(fds[1]);
+}
+
 // regression test. does reparent() violate the parent-then-child
 // locking order when giving away a child to init, so that exit()
 // deadlocks against init's wait()? also used to trigger a "panic:
@@ -1959,6 +2069,8 @@ iref(char *s)
 void
 forktest(char *s)
 {
+  // fork only fails once memory runs out, so
+  // just go well past the old 64-process table.
   enum{ N = 1000 };
   int n, pid;
 
@@ -1975,8 +2087,39 @@ forktest(char *s)
     exit(1);
   }
 
+  for(; n > 0; n--){
+    if(wait(0) < 0){
+      printf("%s: wait stopped early\n", s);
+      exit(1);
+    }
+  }
+
+  if(wait(0) != -1){
+    printf("%s: wait got too many\n", s);
+    exit(1);
+  }
+}
+
+// fork until memory runs out, which is the only limit on
+// processes, and check that fork then fails cleanly and that
+// every child can still be reaped. Slow and memory-hungry,
+// so it is not among the quick tests.
+void
+forkfail(char *s)
+{
+  enum{ N = 100000 };
+  int n, pid;
+
+  for(n=0; n<N; n++){
+    pid = fork();
+    if(pid < 0)
+      break;
+    if(pid == 0)
+      exit(0);
+  }
+
   if(n == N){
-    printf("%s: fork claimed to work 1000 times!\n", s);
+    printf("%s: fork claimed to work %d times!\n", s, N);
     exit(1);
   }
 
@@ -2601,6 +2744,8 @@ struct test {
   {twochildren, "twochildren"},
   {forkfork, "forkfork"},
   {forkforkfork, "forkforkfork"},
+  {cowfork, "cowfork"},
+  {setprio, "setprio"},
   {reparent2, "reparent2"},
   {mem, "mem"},
   {sharedfd, "sharedfd"},
@@ -2931,6 +3076,7 @@ struct test slowtests[] = {
   {execout, "execout"},
   {diskfull, "diskfull"},
   {outofinodes, "outofinodes"},
+  {forkfail, "forkfail"},
     
   { 0, 0},
 };
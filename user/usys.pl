@@ -39,4 +39,15 @@ entry("uptime");
 entry("yield");
 entry("send_signal");
 entry("set_signal_handler");
-entry("alarm");
\ No newline at end of file
+entry("alarm");
+entry("setpriority");
+entry("schedstat");
+entry("set_signal_batch_handler");
+entry("mchan");
+entry("setitimer");
+entry("aioread");
+entry("aiowrite");
+entry("setpgid");
+entry("getpgid");
+entry("send_signal_group");
+entry("sigaltstack");
\ No newline at end of file